@@ -0,0 +1,229 @@
+//
+//  AnsiExport.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  struct AnsiExportStats
+  {
+    size_t num_bytes = 0;
+    size_t num_bytes_naive = 0; // What one SGR sequence per cell would have cost.
+  };
+
+  inline void append_utf8(std::string& out, char32_t cp)
+  {
+    if (cp < 0x80)
+      out += static_cast<char>(cp);
+    else if (cp < 0x800)
+    {
+      out += static_cast<char>(0xC0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+      out += static_cast<char>(0xE0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+      out += static_cast<char>(0xF0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  // Index of the color in the 256 color terminal palette, or -1 for the default and transparent colors.
+  inline int ansi_palette_index(const t8::Color& color)
+  {
+    static constexpr t8::Color16 basic[16] =
+    {
+      t8::Color16::Black, t8::Color16::DarkRed, t8::Color16::DarkGreen, t8::Color16::DarkYellow,
+      t8::Color16::DarkBlue, t8::Color16::DarkMagenta, t8::Color16::DarkCyan, t8::Color16::LightGray,
+      t8::Color16::DarkGray, t8::Color16::Red, t8::Color16::Green, t8::Color16::Yellow,
+      t8::Color16::Blue, t8::Color16::Magenta, t8::Color16::Cyan, t8::Color16::White,
+    };
+    const int idx = color.get_index();
+    for (int i = 0; i < 16; ++i)
+      if (t8::Color(basic[i]).get_index() == idx)
+        return i;
+    const auto color_str = color.str();
+    int cr = 0, cg = 0, cb = 0, gray = 0;
+    if (std::sscanf(color_str.c_str(), "rgb6:[%d, %d, %d]", &cr, &cg, &cb) == 3)
+      return 16 + 36*cr + 6*cg + cb;
+    if (std::sscanf(color_str.c_str(), "gray24:{%d}", &gray) == 1)
+      return 232 + gray;
+    return -1;
+  }
+
+  // Writes a texture as ANSI art with as few escape sequences as possible:
+  // * SGR sequences are only emitted when the fg or bg color changes, so a run of equally
+  //   colored cells costs nothing but its glyphs.
+  // * Each color gets the shortest code that represents it exactly, i.e. 30-37 / 90-97 for
+  //   the 16 basic colors and 38;5;n for rgb6 and gray24. Textures never hold colors outside
+  //   the 256 color palette, so truecolor is never the cheapest encoding.
+  // * Runs of blank cells with the default bg become a single cursor forward and
+  //   trailing blank cells of a row are dropped.
+  // Colors equal to the ANSI default fg / bg (as well as the transparent colors) are written
+  //   as 39 / 49, which the loader maps back to --set_ansi_default_fg / --set_ansi_default_bg.
+  class AnsiExport
+  {
+  public:
+    AnsiExport(const t8::Color& a_default_fg, const t8::Color& a_default_bg, bool a_ascii_only = false)
+      : default_fg(a_default_fg)
+      , default_bg(a_default_bg)
+      , ascii_only(a_ascii_only)
+    {}
+
+    bool write(const std::string& file_path, const t8::Texture& texture)
+    {
+      const auto out = encode(texture);
+      std::ofstream fs(file_path, std::ios::binary);
+      fs.write(out.data(), static_cast<std::streamsize>(out.size()));
+      return static_cast<bool>(fs);
+    }
+
+    // The ANSI art as written by write(), e.g. for printing straight to a terminal.
+    std::string encode(const t8::Texture& texture)
+    {
+      std::string out;
+      stats = {};
+      for (int r = 0; r < texture.size.r; ++r)
+      {
+        int num_cols = texture.size.c;
+        while (num_cols > 0 && is_blank(texture(r, num_cols - 1)))
+          num_cols--;
+
+        const std::string* fg = &default_fg_code;
+        const std::string* bg = &default_bg_code;
+        for (int c = 0; c < num_cols; )
+        {
+          const auto& textel = texture(r, c);
+          if (is_blank(textel))
+          {
+            int run = 1;
+            while (c + run < num_cols && is_blank(texture(r, c + run)))
+              run++;
+            if (bg != &default_bg_code)
+            {
+              out += "\x1b[49m";
+              bg = &default_bg_code;
+            }
+            if (run > 4)
+              out += "\x1b[" + std::to_string(run) + "C";
+            else
+              out.append(run, ' ');
+            stats.num_bytes_naive += run*(sizeof("\x1b[39;49m ") - 1);
+            c += run;
+            continue;
+          }
+
+          const auto& fg_code = sgr_code(textel.fg_color, false);
+          const auto& bg_code = sgr_code(textel.bg_color, true);
+          const bool fg_changed = &fg_code != fg;
+          const bool bg_changed = &bg_code != bg;
+          if (fg_changed || bg_changed)
+          {
+            out += "\x1b[";
+            if (fg_changed)
+              out += fg_code;
+            if (fg_changed && bg_changed)
+              out += ';';
+            if (bg_changed)
+              out += bg_code;
+            out += 'm';
+            fg = &fg_code;
+            bg = &bg_code;
+          }
+          const size_t glyph_start = out.size();
+          append_glyph(out, textel.glyph);
+          stats.num_bytes_naive += (sizeof("\x1b[;m") - 1) + fg_code.size() + bg_code.size()
+            + (out.size() - glyph_start);
+          c++;
+        }
+        if (fg != &default_fg_code || bg != &default_bg_code)
+          out += "\x1b[0m";
+        out += "\r\n";
+        stats.num_bytes_naive += 2;
+      }
+      stats.num_bytes = out.size();
+      return out;
+    }
+
+    const AnsiExportStats& get_stats() const { return stats; }
+
+  private:
+    bool is_default(const t8::Color& color, const t8::Color& default_color) const
+    {
+      const int idx = color.get_index();
+      return idx == default_color.get_index()
+        || idx == t8::Color(t8::Color16::Transparent).get_index()
+        || idx == t8::Color(t8::Color16::Transparent2).get_index()
+        || idx == t8::Color(t8::Color16::Default).get_index();
+    }
+
+    bool is_blank(const t8::Textel& textel) const
+    {
+      const bool blank_glyph = (textel.glyph.preferred == U' ' || textel.glyph.preferred == t8::Glyph::none32)
+        && (textel.glyph.fallback == ' ' || textel.glyph.fallback == t8::Glyph::none);
+      return blank_glyph && is_default(textel.bg_color, default_bg);
+    }
+
+    void append_glyph(std::string& out, const t8::Glyph& glyph) const
+    {
+      if (!ascii_only && glyph.preferred != t8::Glyph::none32)
+        append_utf8(out, glyph.preferred);
+      else if (glyph.fallback != t8::Glyph::none)
+        out += glyph.fallback;
+      else
+        out += ' ';
+    }
+
+    // The code is built once per distinct color, from its string form.
+    // The returned reference is stable (unordered_map nodes don't move), which lets write()
+    //   detect color changes by address.
+    const std::string& sgr_code(const t8::Color& color, bool bg)
+    {
+      const auto& default_code = bg ? default_bg_code : default_fg_code;
+      if (is_default(color, bg ? default_bg : default_fg))
+        return default_code;
+      auto& cache = bg ? bg_codes : fg_codes;
+      const int idx = color.get_index();
+      auto it = cache.find(idx);
+      if (it != cache.end())
+        return it->second;
+
+      const int palette_idx = ansi_palette_index(color);
+      if (palette_idx < 0)
+        return default_code;
+      std::string code;
+      if (palette_idx < 16)
+        code = std::to_string((palette_idx < 8 ? 30 + palette_idx : 90 + palette_idx - 8) + (bg ? 10 : 0));
+      else
+        code = (bg ? "48;5;" : "38;5;") + std::to_string(palette_idx);
+      return cache.emplace(idx, code).first->second;
+    }
+
+    t8::Color default_fg;
+    t8::Color default_bg;
+    bool ascii_only = false;
+    const std::string default_fg_code = "39";
+    const std::string default_bg_code = "49";
+    std::unordered_map<int, std::string> fg_codes;
+    std::unordered_map<int, std::string> bg_codes;
+    AnsiExportStats stats;
+  };
+
+}
@@ -0,0 +1,464 @@
+//
+//  AnsiStreamImporter.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  enum class AnsiStreamEncoding { Auto, Utf8, Cp437 };
+
+  struct AnsiStreamStats
+  {
+    uint64_t num_bytes = 0;
+    double seconds = 0.;
+    AnsiStreamEncoding encoding = AnsiStreamEncoding::Auto;
+
+    double mb_per_s() const { return seconds > 0. ? num_bytes/1e6/seconds : 0.; }
+  };
+
+  inline char32_t cp437_to_unicode(uint8_t ch)
+  {
+    static constexpr char16_t upper[128] =
+    {
+      0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+      0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+      0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+      0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+      0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+      0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+      0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+      0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+    };
+    return ch < 128 ? static_cast<char32_t>(ch) : static_cast<char32_t>(upper[ch - 128]);
+  }
+
+  inline char ascii_fallback(char32_t cp)
+  {
+    if (cp < 128)
+      return static_cast<char>(cp);
+    switch (cp)
+    {
+      case 0x00A0: return ' ';
+      case 0x2591: return '.';
+      case 0x2592: return ':';
+      case 0x2593: return '%';
+      case 0x2500: case 0x2501: case 0x2550: return '-';
+      case 0x2502: case 0x2503: case 0x2551: return '|';
+      default: break;
+    }
+    if (0x2500 <= cp && cp <= 0x257F)
+      return '+';
+    if (0x2580 <= cp && cp <= 0x259F)
+      return '#';
+    return '?';
+  }
+
+  // Imports ANSI art (.ans, .asc, .nfo, captured terminal logs etc.) without ever holding
+  //   the whole file in memory. The file is read in fixed size chunks and fed through a
+  //   byte-wise state machine for text, SGR colors, cursor movement and erasing (EL / ED).
+  // Charset designations (e.g. ESC ( B from tput sgr0) as well as OSC and DCS strings
+  //   (e.g. window titles) are skipped.
+  // The first pass only measures the extent of the art and the second pass writes
+  //   the textels straight into the target texture, so peak memory is the texture plus one chunk.
+  // Without a declared encoding the file is treated as UTF-8 unless it contains invalid
+  //   UTF-8, in which case it is treated as CP437.
+  class AnsiStreamImporter
+  {
+  public:
+    AnsiStreamImporter(const t8::Color& a_default_fg, const t8::Color& a_default_bg, int a_wrap_width = 80)
+      : default_fg(a_default_fg)
+      , default_bg(a_default_bg)
+      , wrap_width(a_wrap_width)
+    {
+      static constexpr t8::Color16 basic[16] =
+      {
+        t8::Color16::Black, t8::Color16::DarkRed, t8::Color16::DarkGreen, t8::Color16::DarkYellow,
+        t8::Color16::DarkBlue, t8::Color16::DarkMagenta, t8::Color16::DarkCyan, t8::Color16::LightGray,
+        t8::Color16::DarkGray, t8::Color16::Red, t8::Color16::Green, t8::Color16::Yellow,
+        t8::Color16::Blue, t8::Color16::Magenta, t8::Color16::Cyan, t8::Color16::White,
+      };
+      for (int i = 0; i < 16; ++i)
+        palette[i] = basic[i];
+      for (int i = 0; i < 216; ++i)
+        palette[16 + i].parse("rgb6:[" + std::to_string(i / 36) + ", " + std::to_string((i / 6) % 6) + ", "
+                              + std::to_string(i % 6) + "]");
+      for (int i = 0; i < 24; ++i)
+        palette[232 + i].parse("gray24:{" + std::to_string(i) + "}");
+    }
+
+    bool load(t8::Texture& texture, const std::string& file_path,
+              AnsiStreamEncoding encoding = AnsiStreamEncoding::Auto)
+    {
+      const auto t0 = std::chrono::steady_clock::now();
+
+      t8::RC extent { 0, 0 };
+      auto measure = [&extent](int r, int c, char32_t, int, int)
+      {
+        extent = { std::max(extent.r, r + 1), std::max(extent.c, c + 1) };
+      };
+      // Erasing with the default bg leaves blank cells, which don't extend the art, but a colored
+      //   bg does. Erasing to the end of a row or of the art stops at the extent found so far.
+      auto measure_erase = [&extent](int r0, int r1, int c0, int c1, int bg)
+      {
+        if (bg < 0)
+          return;
+        r1 = r1 < 0 ? extent.r : r1;
+        c1 = c1 < 0 ? extent.c : c1;
+        if (r0 < r1 && c0 < c1)
+          extent = { std::max(extent.r, r1), std::max(extent.c, c1) };
+      };
+      bool invalid_utf8 = false;
+      stats = {};
+      if (encoding != AnsiStreamEncoding::Cp437)
+      {
+        if (!run(file_path, false, measure, measure_erase, invalid_utf8))
+          return false;
+        if (invalid_utf8 && encoding == AnsiStreamEncoding::Auto)
+        {
+          extent = { 0, 0 };
+          encoding = AnsiStreamEncoding::Cp437;
+        }
+        else
+          encoding = AnsiStreamEncoding::Utf8;
+      }
+      if (encoding == AnsiStreamEncoding::Cp437 && !run(file_path, true, measure, measure_erase, invalid_utf8))
+        return false;
+
+      const bool cp437 = encoding == AnsiStreamEncoding::Cp437;
+      texture = t8::Texture { extent };
+      t8::Textel blank;
+      blank.glyph = t8::Glyph { U' ', ' ' };
+      blank.fg_color = default_fg;
+      blank.bg_color = default_bg;
+      for (int r = 0; r < extent.r; ++r)
+        for (int c = 0; c < extent.c; ++c)
+          texture.set_textel(r, c, blank);
+      auto write = [&](int r, int c, char32_t cp, int fg, int bg)
+      {
+        t8::Textel textel;
+        textel.glyph = t8::Glyph { cp, ascii_fallback(cp) };
+        textel.fg_color = fg < 0 ? default_fg : palette[fg];
+        textel.bg_color = bg < 0 ? default_bg : palette[bg];
+        texture.set_textel(r, c, textel);
+      };
+      auto erase = [&](int r0, int r1, int c0, int c1, int bg)
+      {
+        t8::Textel textel = blank;
+        textel.bg_color = bg < 0 ? default_bg : palette[bg];
+        r1 = std::min(r1 < 0 ? extent.r : r1, extent.r);
+        c1 = std::min(c1 < 0 ? extent.c : c1, extent.c);
+        for (int r = r0; r < r1; ++r)
+          for (int c = c0; c < c1; ++c)
+            texture.set_textel(r, c, textel);
+      };
+      if (!run(file_path, cp437, write, erase, invalid_utf8))
+        return false;
+
+      stats.encoding = encoding;
+      stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      return true;
+    }
+
+    // Bytes are counted once even though the file is read twice.
+    const AnsiStreamStats& get_stats() const { return stats; }
+
+  private:
+    static constexpr size_t chunk_size = 1 << 20;
+
+    // Charset : the designator byte after ESC ( / ) / * / +.
+    // Str : an OSC or DCS string, which ends with BEL or ST (ESC \\).
+    enum class State { Text, Esc, Csi, Charset, Str, StrEsc };
+
+    struct Parser
+    {
+      State state = State::Text;
+      int row = 0;
+      int col = 0;
+      int saved_row = 0;
+      int saved_col = 0;
+      int fg = -1; // -1 : default, else palette index.
+      int bg = -1;
+      bool bold = false;
+      bool blink = false;
+      std::vector<int> params;
+      char32_t utf8_cp = 0;
+      int utf8_left = 0;
+    };
+
+    // sink(r, c, cp, fg, bg) writes a glyph and erase(r0, r1, c0, c1, bg) blanks the cells in
+    //   [r0, r1) x [c0, c1), where r1 or c1 < 0 means to the end of the art.
+    template<typename Sink, typename EraseSink>
+    bool run(const std::string& file_path, bool cp437, Sink&& sink, EraseSink&& erase, bool& invalid_utf8)
+    {
+      std::ifstream fs(file_path, std::ios::binary);
+      if (!fs)
+        return false;
+      std::vector<char> chunk(chunk_size);
+      Parser p;
+      uint64_t num_bytes = 0;
+      bool eof = false;
+      while (!eof && fs)
+      {
+        fs.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        const auto n = static_cast<size_t>(fs.gcount());
+        if (n == 0)
+          break;
+        num_bytes += n;
+        for (size_t i = 0; i < n && !eof; ++i)
+          eof = feed(p, static_cast<uint8_t>(chunk[i]), cp437, sink, erase, invalid_utf8);
+      }
+      stats.num_bytes = num_bytes;
+      return true;
+    }
+
+    // Returns true at the end of the art (SUB, which precedes the SAUCE record).
+    template<typename Sink, typename EraseSink>
+    bool feed(Parser& p, uint8_t ch, bool cp437, Sink& sink, EraseSink& erase, bool& invalid_utf8)
+    {
+      switch (p.state)
+      {
+        case State::Text:
+          if (p.utf8_left > 0)
+          {
+            if ((ch & 0xC0) == 0x80)
+            {
+              p.utf8_cp = (p.utf8_cp << 6) | (ch & 0x3F);
+              if (--p.utf8_left == 0)
+                put(p, p.utf8_cp, sink);
+              return false;
+            }
+            invalid_utf8 = true;
+            p.utf8_left = 0;
+          }
+          if (ch == 0x1B)
+            p.state = State::Esc;
+          else if (ch == 0x1A)
+            return true;
+          else if (ch == '\r')
+            p.col = 0;
+          else if (ch == '\n')
+          {
+            p.row++;
+            p.col = 0;
+          }
+          else if (ch == '\t')
+            p.col = (p.col / 8 + 1)*8;
+          else if (ch < 0x20 || ch == 0x7F)
+            break;
+          else if (ch < 0x80)
+            put(p, ch, sink);
+          else if (cp437)
+            put(p, cp437_to_unicode(ch), sink);
+          else if ((ch & 0xE0) == 0xC0)
+          {
+            p.utf8_cp = ch & 0x1F;
+            p.utf8_left = 1;
+          }
+          else if ((ch & 0xF0) == 0xE0)
+          {
+            p.utf8_cp = ch & 0x0F;
+            p.utf8_left = 2;
+          }
+          else if ((ch & 0xF8) == 0xF0)
+          {
+            p.utf8_cp = ch & 0x07;
+            p.utf8_left = 3;
+          }
+          else
+            invalid_utf8 = true;
+          break;
+        case State::Esc:
+          p.state = State::Text;
+          if (ch == '[')
+          {
+            p.params.clear();
+            p.params.emplace_back(0);
+            p.state = State::Csi;
+          }
+          else if (ch == '(' || ch == ')' || ch == '*' || ch == '+')
+            p.state = State::Charset;
+          else if (ch == ']' || ch == 'P')
+            p.state = State::Str;
+          else if (ch == '7')
+          {
+            p.saved_row = p.row;
+            p.saved_col = p.col;
+          }
+          else if (ch == '8')
+          {
+            p.row = p.saved_row;
+            p.col = p.saved_col;
+          }
+          break;
+        case State::Charset:
+          p.state = State::Text;
+          break;
+        case State::Str:
+          if (ch == 0x07)
+            p.state = State::Text;
+          else if (ch == 0x1B)
+            p.state = State::StrEsc;
+          break;
+        case State::StrEsc:
+          // Anything but ST ends the string and starts a new escape sequence.
+          p.state = State::Esc;
+          if (ch == '\\')
+            p.state = State::Text;
+          else
+            return feed(p, ch, cp437, sink, erase, invalid_utf8);
+          break;
+        case State::Csi:
+          if ('0' <= ch && ch <= '9')
+            p.params.back() = std::min(p.params.back()*10 + (ch - '0'), 1 << 20);
+          else if (ch == ';')
+            p.params.emplace_back(0);
+          else if (0x40 <= ch && ch <= 0x7E)
+          {
+            execute_csi(p, static_cast<char>(ch), erase);
+            p.state = State::Text;
+          }
+          break;
+      }
+      return false;
+    }
+
+    template<typename Sink>
+    void put(Parser& p, char32_t cp, Sink& sink)
+    {
+      if (wrap_width > 0 && p.col >= wrap_width)
+      {
+        p.row++;
+        p.col = 0;
+      }
+      int fg = p.fg;
+      if (p.bold && 0 <= fg && fg < 8)
+        fg += 8;
+      sink(p.row, p.col, cp, fg, effective_bg(p));
+      p.col++;
+    }
+
+    static int effective_bg(const Parser& p)
+    {
+      if (p.blink && 0 <= p.bg && p.bg < 8)
+        return p.bg + 8; // iCE colors.
+      return p.bg;
+    }
+
+    template<typename EraseSink>
+    void execute_csi(Parser& p, char cmd, EraseSink& erase)
+    {
+      const int n = std::max(1, p.params[0]);
+      const int bg = effective_bg(p);
+      switch (cmd)
+      {
+        case 'A': p.row = std::max(0, p.row - n); break;
+        case 'B': p.row += n; break;
+        case 'C': p.col += n; break;
+        case 'D': p.col = std::max(0, p.col - n); break;
+        case 'H':
+        case 'f':
+          p.row = std::max(1, p.params[0]) - 1;
+          p.col = p.params.size() > 1 ? std::max(1, p.params[1]) - 1 : 0;
+          break;
+        case 's': p.saved_row = p.row; p.saved_col = p.col; break;
+        case 'u': p.row = p.saved_row; p.col = p.saved_col; break;
+        case 'm': execute_sgr(p); break;
+        case 'K': // EL
+          if (p.params[0] == 0)
+            erase(p.row, p.row + 1, p.col, -1, bg);
+          else if (p.params[0] == 1)
+            erase(p.row, p.row + 1, 0, p.col + 1, bg);
+          else if (p.params[0] == 2)
+            erase(p.row, p.row + 1, 0, -1, bg);
+          break;
+        case 'J': // ED
+          if (p.params[0] == 0)
+          {
+            erase(p.row, p.row + 1, p.col, -1, bg);
+            erase(p.row + 1, -1, 0, -1, bg);
+          }
+          else if (p.params[0] == 1)
+          {
+            erase(0, p.row, 0, -1, bg);
+            erase(p.row, p.row + 1, 0, p.col + 1, bg);
+          }
+          else if (p.params[0] == 2 || p.params[0] == 3)
+            erase(0, -1, 0, -1, bg);
+          break;
+        default: break;
+      }
+    }
+
+    void execute_sgr(Parser& p)
+    {
+      const auto& prm = p.params;
+      const int num = static_cast<int>(prm.size());
+      for (int i = 0; i < num; ++i)
+      {
+        const int code = prm[i];
+        if (code == 0)
+        {
+          p.fg = -1;
+          p.bg = -1;
+          p.bold = false;
+          p.blink = false;
+        }
+        else if (code == 1)
+          p.bold = true;
+        else if (code == 5)
+          p.blink = true;
+        else if (code == 22)
+          p.bold = false;
+        else if (code == 25)
+          p.blink = false;
+        else if (30 <= code && code <= 37)
+          p.fg = code - 30;
+        else if (code == 39)
+          p.fg = -1;
+        else if (40 <= code && code <= 47)
+          p.bg = code - 40;
+        else if (code == 49)
+          p.bg = -1;
+        else if (90 <= code && code <= 97)
+          p.fg = code - 90 + 8;
+        else if (100 <= code && code <= 107)
+          p.bg = code - 100 + 8;
+        else if ((code == 38 || code == 48) && i + 1 < num)
+        {
+          int idx = -1;
+          if (prm[i + 1] == 5 && i + 2 < num)
+          {
+            idx = std::clamp(prm[i + 2], 0, 255);
+            i += 2;
+          }
+          else if (prm[i + 1] == 2 && i + 4 < num)
+          {
+            auto to6 = [](int v) { return (std::clamp(v, 0, 255)*5 + 127) / 255; };
+            idx = 16 + 36*to6(prm[i + 2]) + 6*to6(prm[i + 3]) + to6(prm[i + 4]);
+            i += 4;
+          }
+          (code == 38 ? p.fg : p.bg) = idx;
+        }
+      }
+    }
+
+    t8::Color default_fg;
+    t8::Color default_bg;
+    int wrap_width = 80;
+    std::array<t8::Color, 256> palette;
+    AnsiStreamStats stats;
+  };
+
+}
@@ -0,0 +1,146 @@
+//
+//  AtlasPacker.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/geom/RC.h>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+
+
+namespace textur
+{
+
+  // Skyline bottom-left rectangle packer.
+  // The skyline is the outline of the packed rectangles as seen from the bottom of the atlas,
+  //   stored as horizontal segments from left to right. Each rectangle is placed where its
+  //   bottom edge ends up the highest (lowest row), and among those the leftmost.
+  class SkylinePacker
+  {
+  public:
+    explicit SkylinePacker(int a_width) : width(a_width)
+    {
+      skyline.push_back({ 0, width, 0 });
+    }
+
+    // Returns false if the rectangle is wider than the atlas.
+    bool insert(const t8::RC& size, t8::RC& pos)
+    {
+      int best_r = INT_MAX;
+      int best_c = INT_MAX;
+      int best_idx = -1;
+      for (int idx = 0; idx < static_cast<int>(skyline.size()); ++idx)
+      {
+        int r = 0;
+        if (fit(idx, size.c, r) && (r < best_r || (r == best_r && skyline[idx].c < best_c)))
+        {
+          best_r = r;
+          best_c = skyline[idx].c;
+          best_idx = idx;
+        }
+      }
+      if (best_idx == -1)
+        return false;
+
+      pos = { best_r, best_c };
+      add_segment(best_idx, { best_c, size.c, best_r + size.r });
+      height = std::max(height, best_r + size.r);
+      return true;
+    }
+
+    int get_height() const { return height; }
+
+  private:
+    struct Segment
+    {
+      int c = 0;
+      int w = 0;
+      int r = 0; // First free row above the segment.
+    };
+
+    // Row at which a rectangle of width w starting at segment idx can be placed.
+    bool fit(int idx, int w, int& r) const
+    {
+      if (skyline[idx].c + w > width)
+        return false;
+      r = 0;
+      int w_left = w;
+      for (int i = idx; w_left > 0; ++i)
+      {
+        r = std::max(r, skyline[i].r);
+        w_left -= skyline[i].w;
+      }
+      return true;
+    }
+
+    void add_segment(int idx, const Segment& seg)
+    {
+      skyline.insert(skyline.begin() + idx, seg);
+      const int seg_end = seg.c + seg.w;
+      for (int i = idx + 1; i < static_cast<int>(skyline.size()); )
+      {
+        auto& s = skyline[i];
+        if (s.c >= seg_end)
+          break;
+        const int shrink = seg_end - s.c;
+        if (shrink >= s.w)
+        {
+          skyline.erase(skyline.begin() + i);
+          continue;
+        }
+        s.c += shrink;
+        s.w -= shrink;
+        break;
+      }
+      for (int i = 0; i + 1 < static_cast<int>(skyline.size()); )
+      {
+        if (skyline[i].r == skyline[i + 1].r)
+        {
+          skyline[i].w += skyline[i + 1].w;
+          skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+          ++i;
+      }
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<Segment> skyline;
+  };
+
+  // Packs rectangles of the given sizes (separated by padding cells) into an atlas and returns
+  //   their positions in the same order as sizes. The atlas is made roughly square.
+  inline std::vector<t8::RC> pack_atlas(const std::vector<t8::RC>& sizes, int padding, t8::RC& atlas_size)
+  {
+    const int n = static_cast<int>(sizes.size());
+    long long area = 0;
+    int max_w = 0;
+    for (const auto& size : sizes)
+    {
+      area += static_cast<long long>(size.r + padding)*(size.c + padding);
+      max_w = std::max(max_w, size.c + padding);
+    }
+    const int width = std::max(max_w, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(area)))));
+
+    // Tallest first, which keeps the skyline flat.
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](int a, int b)
+    {
+      return sizes[a].r != sizes[b].r ? sizes[a].r > sizes[b].r : sizes[a].c > sizes[b].c;
+    });
+
+    SkylinePacker packer { width };
+    std::vector<t8::RC> positions(n);
+    for (int idx : order)
+      packer.insert({ sizes[idx].r + padding, sizes[idx].c + padding }, positions[idx]);
+    atlas_size = { std::max(0, packer.get_height() - padding), std::max(0, width - padding) };
+    return positions;
+  }
+
+}
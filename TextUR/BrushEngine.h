@@ -0,0 +1,240 @@
+//
+//  BrushEngine.h
+//  TextUR
+//
+
+#pragma once
+#include "ViewportCache.h"
+#include "CounterRng.h"
+#include <Termin8or/drawing/Drawing.h>
+#include <Termin8or/drawing/Texture.h>
+#include <Termin8or/geom/RC.h>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  enum class BrushShape { Circle, Square, Diamond, Stamp, NUM_ITEMS };
+
+  inline std::string to_string(BrushShape shape)
+  {
+    switch (shape)
+    {
+      case BrushShape::Circle: return "circle";
+      case BrushShape::Square: return "square";
+      case BrushShape::Diamond: return "diamond";
+      case BrushShape::Stamp: return "stamp";
+      default: return "";
+    }
+  }
+
+  inline bool parse_brush_shape(const std::string& str, BrushShape& shape)
+  {
+    for (int s = 0; s < static_cast<int>(BrushShape::Stamp); ++s)
+      if (str == to_string(static_cast<BrushShape>(s)))
+      {
+        shape = static_cast<BrushShape>(s);
+        return true;
+      }
+    return false;
+  }
+
+  // Horizontal run of cells [c0, c1] on row r, relative to the brush center.
+  struct Span
+  {
+    int r = 0;
+    int c0 = 0;
+    int c1 = 0;
+  };
+  using StampMask = std::vector<Span>;
+
+  inline int num_cells(const StampMask& mask)
+  {
+    int n = 0;
+    for (const auto& span : mask)
+      n += span.c1 - span.c0 + 1;
+    return n;
+  }
+
+  // Calls f(pos, cell_idx) for each cell of the mask centered at center that lies inside size.
+  // cell_idx is the unclipped running index of the cell within the mask.
+  template<typename Func>
+  void apply_mask(const StampMask& mask, const t8::RC& center, const t8::RC& size, Func&& f)
+  {
+    int cell_idx = 0;
+    for (const auto& span : mask)
+    {
+      const int r = center.r + span.r;
+      const int span_len = span.c1 - span.c0 + 1;
+      if (0 <= r && r < size.r)
+      {
+        const int c0 = std::max(0, center.c + span.c0);
+        const int c1 = std::min(size.c - 1, center.c + span.c1);
+        for (int c = c0; c <= c1; ++c)
+          f(t8::RC { r, c }, cell_idx + (c - center.c - span.c0));
+      }
+      cell_idx += span_len;
+    }
+  }
+
+  // Builds brush stamp masks as span lists and caches them by shape, radius and aspect ratio.
+  class BrushEngine
+  {
+  public:
+    // The classic small brush pattern.
+    const StampMask& small_mask() const { return mask_small; }
+
+    const StampMask& get_mask(BrushShape shape, float radius, float aspect_ratio)
+    {
+      if (shape == BrushShape::Stamp)
+        return mask_stamp;
+      const auto key = std::make_tuple(shape,
+                                       static_cast<int>(std::round(radius*100.f)),
+                                       static_cast<int>(std::round(aspect_ratio*100.f)));
+      auto it = cache.find(key);
+      if (it != cache.end())
+        return it->second;
+      return cache[key] = build_mask(shape, radius, aspect_ratio);
+    }
+
+    // Every cell of the stamp texture that isn't see-through becomes part of the mask.
+    void set_stamp(const t8::Texture& stamp)
+    {
+      mask_stamp.clear();
+      const t8::RC center { stamp.size.r / 2, stamp.size.c / 2 };
+      for (int r = 0; r < stamp.size.r; ++r)
+      {
+        int c0 = -1;
+        for (int c = 0; c <= stamp.size.c; ++c)
+        {
+          const bool inside = c < stamp.size.c && !is_see_through(stamp(r, c));
+          if (inside && c0 == -1)
+            c0 = c;
+          else if (!inside && c0 != -1)
+          {
+            mask_stamp.push_back({ r - center.r, c0 - center.c, c - 1 - center.c });
+            c0 = -1;
+          }
+        }
+      }
+    }
+
+    bool has_stamp() const { return !mask_stamp.empty(); }
+
+  private:
+    static StampMask build_mask(BrushShape shape, float radius, float aspect_ratio)
+    {
+      // The circle defines the extents of the other shapes so that they all match in size.
+      StampMask circle;
+      auto positions = t8x::filled_circle_positions({ 0, 0 }, radius, aspect_ratio);
+      std::map<int, std::pair<int, int>> rows;
+      for (const auto& p : positions)
+      {
+        auto it = rows.find(p.r);
+        if (it == rows.end())
+          rows[p.r] = { p.c, p.c };
+        else
+          it->second = { std::min(it->second.first, p.c), std::max(it->second.second, p.c) };
+      }
+      for (const auto& [r, cc] : rows)
+        circle.push_back({ r, cc.first, cc.second });
+      if (shape == BrushShape::Circle || circle.empty())
+        return circle;
+
+      const int r0 = circle.front().r;
+      const int r1 = circle.back().r;
+      int c0 = 0, c1 = 0;
+      for (const auto& span : circle)
+      {
+        c0 = std::min(c0, span.c0);
+        c1 = std::max(c1, span.c1);
+      }
+      StampMask mask;
+      for (int r = r0; r <= r1; ++r)
+      {
+        if (shape == BrushShape::Square)
+          mask.push_back({ r, c0, c1 });
+        else if (shape == BrushShape::Diamond)
+        {
+          const int r_ext = r < 0 ? -r0 : r1;
+          const float t = r_ext == 0 ? 1.f : 1.f - std::abs(static_cast<float>(r))/(r_ext + 1);
+          mask.push_back({ r,
+                           static_cast<int>(std::round(c0*t)),
+                           static_cast<int>(std::round(c1*t)) });
+        }
+      }
+      return mask;
+    }
+
+    static StampMask build_small_mask()
+    {
+      StampMask mask;
+      for (int i = -2; i <= 2; ++i)
+      {
+        int j_offs = std::abs(i) == 2 ? 2 : 4;
+        mask.push_back({ i, -j_offs, j_offs + 1 });
+      }
+      return mask;
+    }
+
+    StampMask mask_small = build_small_mask();
+    StampMask mask_stamp;
+    std::map<std::tuple<BrushShape, int, int>, StampMask> cache;
+  };
+
+  // Decides which cells of a stamp mask a randomized brush stroke paints.
+  // A cell at distance d from the center (rows counting twice) is accepted with
+  //   probability density*P(|N(0, d)| < falloff), which for density = 1 and falloff = 0.1
+  //   matches the old per-cell rejection sampling. The probabilities only depend on the mask and
+  //   the parameters so they are cached, and each stroke then only needs one uniform sample per cell.
+  class RandomBrush
+  {
+  public:
+    void set_seed(uint64_t seed) { rng.set_seed(seed); }
+    uint64_t get_seed() const { return rng.get_seed(); }
+    
+    // Fills accept with one entry per cell of mask (see apply_mask()).
+    void generate(const StampMask& mask, float density, float falloff, std::vector<uint8_t>& accept)
+    {
+      const auto& prob = probabilities(mask, density, falloff);
+      const int n = static_cast<int>(prob.size());
+      const uint64_t stroke = stroke_counter++;
+      accept.resize(n);
+      for (int i = 0; i < n; ++i)
+        accept[i] = rng.uniform(stroke, static_cast<uint64_t>(i)) < prob[i];
+    }
+    
+  private:
+    const std::vector<float>& probabilities(const StampMask& mask, float density, float falloff)
+    {
+      const auto key = std::make_tuple(&mask, num_cells(mask),
+                                       static_cast<int>(std::round(density*1000.f)),
+                                       static_cast<int>(std::round(falloff*1000.f)));
+      auto it = prob_cache.find(key);
+      if (it != prob_cache.end())
+        return it->second;
+      
+      std::vector<float> prob;
+      prob.reserve(num_cells(mask));
+      for (const auto& span : mask)
+        for (int c = span.c0; c <= span.c1; ++c)
+        {
+          const float dist = std::sqrt(4.f*span.r*span.r + static_cast<float>(c*c));
+          const float p = dist == 0.f ? 1.f : std::erf(falloff/(std::sqrt(2.f)*dist));
+          prob.emplace_back(std::min(1.f, density*p));
+        }
+      return prob_cache[key] = std::move(prob);
+    }
+  
+    CounterRng rng;
+    uint64_t stroke_counter = 0;
+    std::map<std::tuple<const StampMask*, int, int, int>, std::vector<float>> prob_cache;
+  };
+
+}
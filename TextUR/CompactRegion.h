@@ -0,0 +1,191 @@
+//
+//  CompactRegion.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <Termin8or/geom/RC.h>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // A rectangle of textels kept as a table of its distinct textels and an index into it
+  //   per cell. The indices take one byte each as long as there are at most 256 distinct
+  //   textels, then two and finally four, so a filled area costs a byte or two per cell
+  //   instead of a whole textel.
+  class CompactRegion
+  {
+  public:
+    CompactRegion() = default;
+
+    // A region with at most 256 distinct textels, given as one index per cell row by row,
+    //   e.g. the noise bands of a fill over the presets it picks from.
+    CompactRegion(const t8::RC& a_size, std::vector<t8::Textel> a_textels, std::vector<uint8_t> a_indices)
+      : region_size(a_size)
+      , textels(std::move(a_textels))
+      , indices(std::move(a_indices))
+    {}
+
+    const t8::RC& size() const { return region_size; }
+    bool empty() const { return textels.empty(); }
+
+    // Calls f(c, textel) for each cell of row r.
+    template<typename F>
+    void for_each_in_row(int r, F&& f) const
+    {
+      const size_t i0 = static_cast<size_t>(r)*region_size.c;
+      if (index_width == 1)
+        for (int c = 0; c < region_size.c; ++c)
+          f(c, textels[indices[i0 + c]]);
+      else
+        for (int c = 0; c < region_size.c; ++c)
+          f(c, textels[index(i0 + c)]);
+    }
+
+    // Writes the region into texture at pos and returns what was there before, so that
+    //   applying an undo step yields its redo step and vice versa. The old contents are read
+    //   row by row just before the row is written, which saves a pass over large fills.
+    // The indices of a row are collected at full width and packed once the row is done.
+    CompactRegion swap_into(t8::Texture& texture, const t8::RC& pos) const
+    {
+      CompactRegion old;
+      if (empty())
+        return old;
+      old.region_size = region_size;
+      old.indices.resize(static_cast<size_t>(region_size.r)*region_size.c);
+      old.slots.assign(1024, empty_slot);
+      std::vector<uint32_t> row_indices(region_size.c);
+      for (int r = 0; r < region_size.r; ++r)
+      {
+        for (int c = 0; c < region_size.c; ++c)
+          row_indices[c] = old.find_or_add(texture(pos.r + r, pos.c + c));
+        old.pack_row(r, row_indices);
+        for_each_in_row(r, [&](int c, const t8::Textel& textel) { texture.set_textel(pos.r + r, pos.c + c, textel); });
+      }
+      old.slots = {};
+      return old;
+    }
+
+  private:
+    static constexpr uint32_t empty_slot = 0xFFFFFFFFu;
+
+    // Open addressing with linear probing over a power of two number of slots, which are
+    //   kept at most half full. Only used while capturing.
+    // Every cell is looked up, since checking for a run of the same textel first is a branch
+    //   that noise fills mispredict half of the time. That makes the hash the main cost, so it
+    //   is a single multiply rather than TextelHash.
+    static size_t slot_hash(const t8::Textel& textel)
+    {
+      const uint64_t key = static_cast<uint64_t>(textel.glyph.preferred)
+        ^ static_cast<uint64_t>(static_cast<unsigned char>(textel.glyph.fallback)) << 21
+        ^ static_cast<uint64_t>(static_cast<uint32_t>(textel.fg_color.get_index())) << 29
+        ^ static_cast<uint64_t>(static_cast<uint32_t>(textel.bg_color.get_index())) << 40
+        ^ static_cast<uint64_t>(textel.mat_raw) << 51;
+      return static_cast<size_t>((key*0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    uint32_t find_or_add(const t8::Textel& textel)
+    {
+      const auto mask = slots.size() - 1;
+      for (size_t s = slot_hash(textel) & mask; ; s = (s + 1) & mask)
+      {
+        const auto idx = slots[s];
+        if (idx == empty_slot)
+          return add(textel);
+        if (textels[idx] == textel)
+          return idx;
+      }
+    }
+
+    uint32_t add(const t8::Textel& textel)
+    {
+      const auto idx = static_cast<uint32_t>(textels.size());
+      textels.emplace_back(textel);
+      if (2*textels.size() > slots.size())
+        rehash(2*slots.size());
+      else
+        insert_slot(idx);
+      if (textels.size() == 257 || textels.size() == 65537)
+        widen();
+      return idx;
+    }
+
+    void insert_slot(uint32_t idx)
+    {
+      const auto mask = slots.size() - 1;
+      size_t s = slot_hash(textels[idx]) & mask;
+      while (slots[s] != empty_slot)
+        s = (s + 1) & mask;
+      slots[s] = idx;
+    }
+
+    void rehash(size_t num_slots)
+    {
+      slots.assign(num_slots, empty_slot);
+      for (uint32_t idx = 0; idx < textels.size(); ++idx)
+        insert_slot(idx);
+    }
+
+    // The width only ever grows, at most twice, and the indices packed so far are
+    //   re-encoded when it does.
+    void widen()
+    {
+      const int old_width = index_width;
+      std::vector<uint8_t> old_indices(indices.size()*2);
+      std::swap(indices, old_indices);
+      index_width *= 2;
+      for (size_t i = 0; i < old_indices.size() / old_width; ++i)
+        set_index(i, read_index(old_indices.data(), old_width, i));
+    }
+
+    void pack_row(int r, const std::vector<uint32_t>& row_indices)
+    {
+      const size_t i0 = static_cast<size_t>(r)*region_size.c;
+      switch (index_width)
+      {
+        case 1:
+          for (int c = 0; c < region_size.c; ++c)
+            indices[i0 + c] = static_cast<uint8_t>(row_indices[c]);
+          break;
+        default:
+          for (int c = 0; c < region_size.c; ++c)
+            set_index(i0 + c, row_indices[c]);
+          break;
+      }
+    }
+
+    static uint32_t read_index(const uint8_t* data, int width, size_t i)
+    {
+      switch (width)
+      {
+        case 1: return data[i];
+        case 2: { uint16_t idx; std::memcpy(&idx, data + 2*i, 2); return idx; }
+        default: { uint32_t idx; std::memcpy(&idx, data + 4*i, 4); return idx; }
+      }
+    }
+
+    uint32_t index(size_t i) const { return read_index(indices.data(), index_width, i); }
+
+    void set_index(size_t i, uint32_t idx)
+    {
+      switch (index_width)
+      {
+        case 1: indices[i] = static_cast<uint8_t>(idx); break;
+        case 2: { const auto idx16 = static_cast<uint16_t>(idx); std::memcpy(indices.data() + 2*i, &idx16, 2); break; }
+        default: std::memcpy(indices.data() + 4*i, &idx, 4); break;
+      }
+    }
+
+    t8::RC region_size { 0, 0 };
+    std::vector<t8::Textel> textels;
+    std::vector<uint8_t> indices;
+    int index_width = 1;
+    std::vector<uint32_t> slots;
+  };
+
+}
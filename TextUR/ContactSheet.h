@@ -0,0 +1,74 @@
+//
+//  ContactSheet.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <algorithm>
+#include <cmath>
+
+
+namespace textur
+{
+
+  // Shrinks a texture to fit within max_size while keeping its aspect ratio.
+  // Each thumbnail cell takes the textel at the center of the block of cells it covers.
+  // Textures that already fit are copied as is.
+  inline t8::Texture make_thumbnail(const t8::Texture& texture, const t8::RC& max_size)
+  {
+    const double scale = std::max({ 1.,
+                                    static_cast<double>(texture.size.r) / max_size.r,
+                                    static_cast<double>(texture.size.c) / max_size.c });
+    const t8::RC size
+    {
+      std::min(max_size.r, static_cast<int>(std::ceil(texture.size.r / scale))),
+      std::min(max_size.c, static_cast<int>(std::ceil(texture.size.c / scale)))
+    };
+    t8::Texture thumbnail { size };
+    for (int r = 0; r < size.r; ++r)
+    {
+      const int src_r = std::min(texture.size.r - 1, static_cast<int>((r + 0.5)*scale));
+      for (int c = 0; c < size.c; ++c)
+      {
+        const int src_c = std::min(texture.size.c - 1, static_cast<int>((c + 0.5)*scale));
+        thumbnail.set_textel(r, c, texture(src_r, src_c));
+      }
+    }
+    return thumbnail;
+  }
+
+  // Lays out num_items slots of slot_size (plus padding cells in between) in a grid
+  //   that is roughly as wide as it is tall on screen, terminal cells being about twice as tall as wide.
+  class ContactSheetLayout
+  {
+  public:
+    ContactSheetLayout(int num_items, const t8::RC& a_slot_size, int a_padding)
+      : slot_size(a_slot_size)
+      , padding(a_padding)
+    {
+      const double slot_aspect = 2.*(slot_size.r + padding) / (slot_size.c + padding);
+      num_grid_cols = std::max(1, static_cast<int>(std::ceil(std::sqrt(num_items*slot_aspect))));
+      num_grid_cols = std::min(num_grid_cols, num_items);
+      num_grid_rows = num_grid_cols > 0 ? (num_items + num_grid_cols - 1) / num_grid_cols : 0;
+    }
+
+    t8::RC get_slot_pos(int idx) const
+    {
+      return { (idx / num_grid_cols)*(slot_size.r + padding), (idx % num_grid_cols)*(slot_size.c + padding) };
+    }
+
+    t8::RC get_sheet_size() const
+    {
+      return { std::max(0, num_grid_rows*(slot_size.r + padding) - padding),
+               std::max(0, num_grid_cols*(slot_size.c + padding) - padding) };
+    }
+
+  private:
+    t8::RC slot_size;
+    int padding = 0;
+    int num_grid_rows = 0;
+    int num_grid_cols = 0;
+  };
+
+}
@@ -0,0 +1,48 @@
+//
+//  CounterRng.h
+//  TextUR
+//
+
+#pragma once
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // Counter-based random number generator.
+  // Each value is a pure function of (seed, stream, counter), so any value can be
+  //   regenerated independently of the others and in any order. That makes batched
+  //   generation trivial and results reproducible from the seed alone.
+  class CounterRng
+  {
+  public:
+    explicit CounterRng(uint64_t a_seed = 0) : seed(a_seed) {}
+    
+    void set_seed(uint64_t a_seed) { seed = a_seed; }
+    uint64_t get_seed() const { return seed; }
+    
+    uint64_t bits(uint64_t stream, uint64_t counter) const
+    {
+      return mix(seed ^ mix(stream*0x9E3779B97F4A7C15ull + counter*0xD1B54A32D192ED03ull));
+    }
+    
+    // Uniform float in [0, 1).
+    float uniform(uint64_t stream, uint64_t counter) const
+    {
+      return static_cast<float>(bits(stream, counter) >> 40) * (1.f / 16777216.f);
+    }
+    
+  private:
+    // SplitMix64 finalizer.
+    static uint64_t mix(uint64_t z)
+    {
+      z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+  
+    uint64_t seed = 0;
+  };
+
+}
@@ -0,0 +1,192 @@
+//
+//  CppHeaderExport.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  struct CppExportTexture
+  {
+    std::string name;
+    const t8::Texture* normal = nullptr;
+    const t8::Texture* shadow = nullptr; // Optional.
+  };
+
+  inline std::string to_cpp_identifier(const std::string& str)
+  {
+    std::string id;
+    for (char ch : str)
+      id += std::isalnum(static_cast<unsigned char>(ch)) ? ch : '_';
+    if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0])))
+      id = "tx_" + id;
+    return id;
+  }
+
+  // Writes the textures as constexpr glyph, color and material arrays in a C++ header so that
+  //   a game can embed them and skip the texture parsing at startup.
+  // All colors go into one palette of t8::Color values, written as Color16 enumerators or as
+  //   rgb6 / gray24 components, so nothing is parsed at runtime. The per-cell color arrays
+  //   are indices into that palette.
+  // The header also gets a make_<variant>() function per texture that builds a t8::Texture.
+  class CppHeaderExport
+  {
+  public:
+    bool write(const std::string& file_path, const std::vector<CppExportTexture>& textures)
+    {
+      palette.clear();
+      palette_lookup.clear();
+      std::ostringstream body;
+      for (const auto& tex : textures)
+      {
+        const auto name = to_cpp_identifier(tex.name);
+        body << "\n  namespace " << name << "\n  {\n";
+        body << "    constexpr int num_rows = " << tex.normal->size.r << ";\n";
+        body << "    constexpr int num_cols = " << tex.normal->size.c << ";\n";
+        write_variant(body, "normal", *tex.normal);
+        if (tex.shadow != nullptr)
+          write_variant(body, "shadow", *tex.shadow);
+        body << "  }\n";
+      }
+
+      const auto ns = to_cpp_identifier(std::filesystem::path(file_path).stem().string());
+      std::ofstream fs(file_path);
+      fs << "//\n//  " << std::filesystem::path(file_path).filename().string() << "\n";
+      fs << "//  Generated by TextUR. Do not edit.\n//\n\n";
+      fs << "#pragma once\n";
+      fs << "#include <Termin8or/drawing/Texture.h>\n";
+      fs << "#include <cstdint>\n\n\n";
+      fs << "namespace " << ns << "\n{\n\n";
+      fs << "  constexpr int num_palette_colors = " << palette.size() << ";\n";
+      fs << "  inline const t8::Color palette[] =\n  {\n";
+      for (const auto& color_expr : palette)
+        fs << "    " << color_expr << ",\n";
+      if (palette.empty())
+        fs << "    t8::Color { t8::Color16::Default },\n";
+      fs << "  };\n\n";
+      fs << "  inline t8::Texture make_texture(int num_rows, int num_cols,\n"
+            "                                  const char32_t* glyph_preferred, const uint8_t* glyph_fallback,\n"
+            "                                  const uint16_t* fg_color, const uint16_t* bg_color,\n"
+            "                                  const uint8_t* mat_raw)\n";
+      fs << "  {\n";
+      fs << "    t8::Texture texture { { num_rows, num_cols } };\n";
+      fs << "    for (int r = 0; r < num_rows; ++r)\n";
+      fs << "      for (int c = 0; c < num_cols; ++c)\n";
+      fs << "      {\n";
+      fs << "        const int i = r*num_cols + c;\n";
+      fs << "        t8::Textel textel;\n";
+      fs << "        textel.glyph = t8::Glyph { glyph_preferred[i], static_cast<char>(glyph_fallback[i]) };\n";
+      fs << "        textel.fg_color = palette[fg_color[i]];\n";
+      fs << "        textel.bg_color = palette[bg_color[i]];\n";
+      fs << "        textel.mat_raw = mat_raw[i];\n";
+      fs << "        texture.set_textel(r, c, textel);\n";
+      fs << "      }\n";
+      fs << "    return texture;\n";
+      fs << "  }\n";
+      fs << body.str();
+      fs << "\n}\n";
+      return static_cast<bool>(fs);
+    }
+
+  private:
+    // C++ expression that constructs color without parsing.
+    static std::string color_expr(const t8::Color& color)
+    {
+      static constexpr std::pair<t8::Color16, const char*> color16_names[] =
+      {
+        { t8::Color16::Transparent, "Transparent" }, { t8::Color16::Transparent2, "Transparent2" },
+        { t8::Color16::Default, "Default" }, { t8::Color16::Black, "Black" },
+        { t8::Color16::DarkRed, "DarkRed" }, { t8::Color16::DarkGreen, "DarkGreen" },
+        { t8::Color16::DarkYellow, "DarkYellow" }, { t8::Color16::DarkBlue, "DarkBlue" },
+        { t8::Color16::DarkMagenta, "DarkMagenta" }, { t8::Color16::DarkCyan, "DarkCyan" },
+        { t8::Color16::LightGray, "LightGray" }, { t8::Color16::DarkGray, "DarkGray" },
+        { t8::Color16::Red, "Red" }, { t8::Color16::Green, "Green" },
+        { t8::Color16::Yellow, "Yellow" }, { t8::Color16::Blue, "Blue" },
+        { t8::Color16::Magenta, "Magenta" }, { t8::Color16::Cyan, "Cyan" },
+        { t8::Color16::White, "White" },
+      };
+      for (const auto& [color16, name] : color16_names)
+        if (t8::Color(color16).get_index() == color.get_index())
+          return std::string("t8::Color { t8::Color16::") + name + " }";
+      const auto color_str = color.str();
+      int cr = 0, cg = 0, cb = 0, gray = 0;
+      if (std::sscanf(color_str.c_str(), "rgb6:[%d, %d, %d]", &cr, &cg, &cb) == 3)
+        return "t8::Color { t8::RGB6 { " + std::to_string(cr) + ", " + std::to_string(cg) + ", " + std::to_string(cb) + " } }";
+      if (std::sscanf(color_str.c_str(), "gray24:{%d}", &gray) == 1)
+        return "t8::Color { t8::Gray24 { " + std::to_string(gray) + " } }";
+      // Textures only hold Color16, rgb6 and gray24 colors.
+      return "t8::Color { t8::Color16::Default }";
+    }
+
+    int color_index(const t8::Color& color)
+    {
+      const int color_idx = color.get_index();
+      auto it = palette_lookup.find(color_idx);
+      if (it != palette_lookup.end())
+        return it->second;
+      const int idx = static_cast<int>(palette.size());
+      palette.emplace_back(color_expr(color));
+      palette_lookup.emplace(color_idx, idx);
+      return idx;
+    }
+
+    template<typename Func>
+    static void write_array(std::ostringstream& os, const char* type, const char* name, int n, Func&& f)
+    {
+      os << "      constexpr " << type << " " << name << "[] =\n      {";
+      for (int i = 0; i < n; ++i)
+        os << (i % 16 == 0 ? "\n        " : " ") << f(i) << ",";
+      if (n == 0)
+        os << "\n        0,";
+      os << "\n      };\n";
+    }
+
+    void write_variant(std::ostringstream& os, const char* variant, const t8::Texture& texture)
+    {
+      const int n = texture.size.r*texture.size.c;
+      auto textel = [&texture](int i) { return texture(i / texture.size.c, i % texture.size.c); };
+      os << "\n    namespace " << variant << "\n    {\n";
+      write_array(os, "char32_t", "glyph_preferred", n, [&](int i)
+      {
+        std::ostringstream oss;
+        oss << "0x" << std::hex << static_cast<uint32_t>(textel(i).glyph.preferred);
+        return oss.str();
+      });
+      // As unsigned bytes since the signedness of char differs between targets.
+      write_array(os, "uint8_t", "glyph_fallback", n, [&](int i)
+      {
+        return std::to_string(static_cast<int>(static_cast<unsigned char>(textel(i).glyph.fallback)));
+      });
+      write_array(os, "uint16_t", "fg_color", n, [&](int i) { return std::to_string(color_index(textel(i).fg_color)); });
+      write_array(os, "uint16_t", "bg_color", n, [&](int i) { return std::to_string(color_index(textel(i).bg_color)); });
+      write_array(os, "uint8_t", "mat_raw", n, [&](int i)
+      {
+        return std::to_string(static_cast<int>(textel(i).mat_raw));
+      });
+      os << "    }\n";
+      os << "\n    inline t8::Texture make_" << variant << "()\n    {\n";
+      os << "      return make_texture(num_rows, num_cols, " << variant << "::glyph_preferred, "
+         << variant << "::glyph_fallback,\n";
+      os << "                          " << variant << "::fg_color, " << variant << "::bg_color, "
+         << variant << "::mat_raw);\n";
+      os << "    }\n";
+    }
+
+    std::vector<std::string> palette; // Color expressions.
+    std::unordered_map<int, int> palette_lookup;
+  };
+
+}
@@ -0,0 +1,212 @@
+//
+//  CustomPresetFile.h
+//  TextUR
+//
+
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // Byte ranges of the three line records (name, normal textel, shadow textel) in the custom
+  //   textel presets file, so that a single record can be replaced without parsing or
+  //   rewriting the rest of the file. Blank lines and comments between the records are kept.
+  // The ranges are scanned the first time a record is replaced and are kept up to date by
+  //   append() and replace() after that. Appending doesn't need them.
+  class CustomPresetFile
+  {
+  public:
+    enum class Result { Ok, Mismatch, IOError };
+
+    void invalidate() { scanned = false; }
+
+    Result append(const std::string& path, const std::vector<std::string>& record)
+    {
+      std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+      if (!fs)
+      {
+        // No file yet.
+        fs.clear();
+        fs.open(path, std::ios::out | std::ios::binary);
+        if (!fs)
+          return Result::IOError;
+      }
+      int64_t pos = static_cast<int64_t>(fs.tellp());
+      if (pos > 0)
+      {
+        fs.seekg(-1, std::ios::end);
+        if (fs.get() != '\n')
+        {
+          fs.seekp(0, std::ios::end);
+          fs.put('\n');
+          pos++;
+        }
+      }
+      fs.seekp(0, std::ios::end);
+      const auto bytes = join(record, "\n") + "\n";
+      fs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+      if (!fs)
+        return Result::IOError;
+      if (scanned)
+        records.push_back({ pos, pos + static_cast<int64_t>(bytes.size()) });
+      return Result::Ok;
+    }
+
+    // Replaces record idx, provided that its first line still is saved_name.
+    // A record of the same length is overwritten in place. Otherwise the bytes before and
+    //   after it are copied around the new record into a temporary file that then replaces
+    //   the file, so a failure halfway never leaves a truncated presets file behind.
+    Result replace(const std::string& path, int idx, const std::vector<std::string>& record,
+                   const std::string& saved_name)
+    {
+      if (!scanned && !scan(path))
+        return Result::IOError;
+      if (idx < 0 || idx >= static_cast<int>(records.size()))
+        return Result::Mismatch;
+      const auto [begin, end] = records[idx];
+
+      std::ifstream fs_in(path, std::ios::binary);
+      std::string old_bytes(static_cast<size_t>(end - begin), '\0');
+      fs_in.seekg(begin);
+      if (!fs_in.read(old_bytes.data(), static_cast<std::streamsize>(old_bytes.size()))
+          || strip_cr(old_bytes.substr(0, old_bytes.find('\n'))) != strip_cr(saved_name))
+      {
+        scanned = false;
+        return Result::Mismatch;
+      }
+      const auto eol = old_bytes.find('\n');
+      const bool crlf = eol != std::string::npos && eol > 0 && old_bytes[eol - 1] == '\r';
+      auto bytes = join(record, crlf ? "\r\n" : "\n");
+      if (!old_bytes.empty() && old_bytes.back() == '\n')
+        bytes += crlf ? "\r\n" : "\n";
+
+      if (bytes.size() == old_bytes.size())
+      {
+        fs_in.close();
+        std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(begin);
+        fs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return fs ? Result::Ok : Result::IOError;
+      }
+
+      const auto tmp_path = path + ".tmp";
+      bool ok = true;
+      {
+        std::ofstream fs_out(tmp_path, std::ios::binary | std::ios::trunc);
+        fs_in.seekg(0);
+        ok = copy_bytes(fs_in, fs_out, begin);
+        fs_out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        fs_in.seekg(end);
+        ok = ok && copy_bytes(fs_in, fs_out, -1);
+      }
+      fs_in.close();
+      std::error_code ec;
+      if (ok)
+        std::filesystem::rename(tmp_path, path, ec);
+      if (!ok || ec)
+      {
+        std::filesystem::remove(tmp_path, ec);
+        return Result::IOError;
+      }
+
+      const int64_t delta = static_cast<int64_t>(bytes.size()) - (end - begin);
+      records[idx].end += delta;
+      for (size_t i = idx + 1; i < records.size(); ++i)
+      {
+        records[i].begin += delta;
+        records[i].end += delta;
+      }
+      return Result::Ok;
+    }
+
+  private:
+    struct Range
+    {
+      int64_t begin = 0;
+      int64_t end = 0;
+    };
+
+    // Skips blank lines and comments the same way the preset loader does.
+    bool scan(const std::string& path)
+    {
+      records.clear();
+      std::ifstream fs(path, std::ios::binary);
+      if (!fs)
+      {
+        // A missing file is an empty file.
+        scanned = !std::filesystem::exists(path);
+        return scanned;
+      }
+      std::string line;
+      int64_t pos = 0;
+      int part = 0;
+      while (std::getline(fs, line))
+      {
+        const int64_t line_begin = pos;
+        pos += static_cast<int64_t>(line.size()) + (fs.eof() ? 0 : 1);
+        if (line.empty() || line.starts_with('#'))
+          continue;
+        if (part == 0)
+          records.push_back({ line_begin, pos });
+        else
+          records.back().end = pos;
+        part = (part + 1) % 3;
+      }
+      // An incomplete record at the end isn't loaded either.
+      if (part != 0)
+        records.pop_back();
+      scanned = true;
+      return true;
+    }
+
+    static std::string strip_cr(std::string line)
+    {
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      return line;
+    }
+
+    static std::string join(const std::vector<std::string>& lines, const char* eol)
+    {
+      std::string ret;
+      for (size_t i = 0; i < lines.size(); ++i)
+      {
+        if (i > 0)
+          ret += eol;
+        ret += lines[i];
+      }
+      return ret;
+    }
+
+    // Copies num_bytes bytes, or everything up to the end of is if num_bytes is negative.
+    static bool copy_bytes(std::istream& is, std::ostream& os, int64_t num_bytes)
+    {
+      std::vector<char> buf(64*1024);
+      while (num_bytes != 0)
+      {
+        const auto n = static_cast<std::streamsize>(num_bytes < 0 ? static_cast<int64_t>(buf.size()) :
+          std::min<int64_t>(num_bytes, static_cast<int64_t>(buf.size())));
+        is.read(buf.data(), n);
+        if (is.gcount() < n && num_bytes > 0)
+          return false;
+        os.write(buf.data(), is.gcount());
+        if (is.gcount() < n)
+          break;
+        if (num_bytes > 0)
+          num_bytes -= n;
+      }
+      return static_cast<bool>(os);
+    }
+
+    std::vector<Range> records;
+    bool scanned = false;
+  };
+
+}
@@ -0,0 +1,162 @@
+//
+//  DirectionalShading.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+
+
+namespace textur
+{
+
+  // Where the sun is. Zenith casts no shadows.
+  enum class SunDirection { Zenith, N, NE, E, SE, S, SW, W, NW, NUM_ITEMS };
+
+  inline std::string to_string(SunDirection dir)
+  {
+    switch (dir)
+    {
+      case SunDirection::Zenith: return "zenith";
+      case SunDirection::N: return "n";
+      case SunDirection::NE: return "ne";
+      case SunDirection::E: return "e";
+      case SunDirection::SE: return "se";
+      case SunDirection::S: return "s";
+      case SunDirection::SW: return "sw";
+      case SunDirection::W: return "w";
+      case SunDirection::NW: return "nw";
+      default: return "";
+    }
+  }
+
+  inline bool parse_sun_direction(const std::string& str, SunDirection& dir)
+  {
+    for (int d = 0; d < static_cast<int>(SunDirection::NUM_ITEMS); ++d)
+      if (str == to_string(static_cast<SunDirection>(d)))
+      {
+        dir = static_cast<SunDirection>(d);
+        return true;
+      }
+    return false;
+  }
+
+  // Casts shadows from tall materials onto their surroundings for a given sun direction.
+  // Each material has a height (0 unless set). A cell is in shadow if some cell between it
+  //   and the sun is taller by at least the distance to it, where a row counts as one step
+  //   and a column as half a step since terminal cells are about twice as tall as wide.
+  // Shadowed cells get their shadow textel through shadow_of(), e.g. the shadow textel of the
+  //   matching preset, so the result only holds textels that -c would also produce.
+  class DirectionalShading
+  {
+  public:
+    // "<mat>:<height>,<mat>:<height>,...", e.g. "2:3,5:1".
+    bool parse_heights(const std::string& str)
+    {
+      std::istringstream iss(str);
+      std::string item;
+      while (std::getline(iss, item, ','))
+      {
+        const auto sep = item.find(':');
+        if (sep == std::string::npos)
+          return false;
+        t8::Textel textel;
+        textel.encode_raw_mat(std::atoi(item.substr(0, sep).c_str()));
+        heights[textel.mat_raw] = std::max(0, std::atoi(item.substr(sep + 1).c_str()));
+      }
+      max_height = *std::max_element(heights.begin(), heights.end());
+      return true;
+    }
+
+    template<typename ShadowOf>
+    t8::Texture shade(const t8::Texture& texture, SunDirection dir, const ShadowOf& shadow_of) const
+    {
+      t8::Texture shaded = texture;
+      if (dir == SunDirection::Zenith || max_height == 0)
+        return shaded;
+      const auto [dr, dc] = sun_step(dir);
+
+      // The shadow mask is computed in parallel, rows being handed out in chunks so that the
+      //   threads don't contend for the counter. The textels are then replaced on this thread.
+      std::vector<uint8_t> mask(static_cast<size_t>(texture.size.r)*texture.size.c, 0);
+      constexpr int chunk_rows = 16;
+      std::atomic<int> next_row { 0 };
+      auto worker = [&]()
+      {
+        for (int r0 = next_row.fetch_add(chunk_rows); r0 < texture.size.r; r0 = next_row.fetch_add(chunk_rows))
+        {
+          const int r1 = std::min(texture.size.r, r0 + chunk_rows);
+          for (int r = r0; r < r1; ++r)
+            for (int c = 0; c < texture.size.c; ++c)
+              mask[static_cast<size_t>(r)*texture.size.c + c] = in_shadow(texture, r, c, dr, dc) ? 1 : 0;
+        }
+      };
+      const int num_threads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()),
+                                                   (texture.size.r + chunk_rows - 1) / chunk_rows));
+      std::vector<std::thread> threads;
+      for (int t = 1; t < num_threads; ++t)
+        threads.emplace_back(worker);
+      worker();
+      for (auto& thread : threads)
+        thread.join();
+
+      for (int r = 0; r < texture.size.r; ++r)
+        for (int c = 0; c < texture.size.c; ++c)
+          if (mask[static_cast<size_t>(r)*texture.size.c + c] != 0)
+            shaded.set_textel(r, c, shadow_of(texture(r, c)));
+      return shaded;
+    }
+
+  private:
+    // One step towards the sun.
+    static std::pair<int, int> sun_step(SunDirection dir)
+    {
+      switch (dir)
+      {
+        case SunDirection::N: return { -1, 0 };
+        case SunDirection::NE: return { -1, 1 };
+        case SunDirection::E: return { 0, 1 };
+        case SunDirection::SE: return { 1, 1 };
+        case SunDirection::S: return { 1, 0 };
+        case SunDirection::SW: return { 1, -1 };
+        case SunDirection::W: return { 0, -1 };
+        case SunDirection::NW: return { -1, -1 };
+        default: return { 0, 0 };
+      }
+    }
+
+    bool in_shadow(const t8::Texture& texture, int r, int c, int dr, int dc) const
+    {
+      const int height = heights[texture(r, c).mat_raw];
+      for (int k = 1; k <= max_height - height; ++k)
+      {
+        const int rr = r + k*dr;
+        if (rr < 0 || rr >= texture.size.r)
+          break;
+        // With a column component, both columns that lie k steps away are checked.
+        for (int sub = dc == 0 ? 0 : 2*k - 1; sub <= (dc == 0 ? 0 : 2*k); ++sub)
+        {
+          const int cc = c + sub*dc;
+          if (cc < 0 || cc >= texture.size.c)
+            continue;
+          if (heights[texture(rr, cc).mat_raw] - height >= k)
+            return true;
+        }
+      }
+      return false;
+    }
+
+    std::array<int, 256> heights {};
+    int max_height = 0;
+  };
+
+}
@@ -0,0 +1,87 @@
+//
+//  LatencyHistogram.h
+//  TextUR
+//
+
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // Latency samples in power of two millisecond buckets: [0, 1), [1, 2), [2, 4), ..., [1024, inf).
+  // Percentiles are computed from the most recent samples only, so memory stays
+  //   constant however long the session is.
+  class LatencyHistogram
+  {
+  public:
+    static constexpr int num_buckets = 12;
+    static constexpr int num_recent = 4096;
+
+    void add(double ms)
+    {
+      int bucket = 0;
+      while (bucket + 1 < num_buckets && ms >= bucket_lower_ms(bucket + 1))
+        bucket++;
+      counts[bucket]++;
+      num_samples++;
+      max_ms = std::max(max_ms, ms);
+      if (static_cast<int>(recent.size()) < num_recent)
+        recent.emplace_back(ms);
+      else
+        recent[(num_samples - 1) % num_recent] = ms;
+    }
+
+    uint64_t get_num_samples() const { return num_samples; }
+
+    double percentile(double p) const
+    {
+      if (recent.empty())
+        return 0.;
+      auto sorted = recent;
+      const auto n = static_cast<size_t>(p/100.*(sorted.size() - 1) + 0.5);
+      std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+      return sorted[n];
+    }
+
+    std::vector<std::string> format(int bar_width = 30) const
+    {
+      std::vector<std::string> lines;
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(1);
+      oss << num_samples << " keys, p50 " << percentile(50) << " ms, p90 " << percentile(90)
+          << " ms, p99 " << percentile(99) << " ms, max " << max_ms << " ms";
+      lines.emplace_back(oss.str());
+      const auto max_count = *std::max_element(counts.begin(), counts.end());
+      for (int b = 0; b < num_buckets; ++b)
+      {
+        std::ostringstream oss_b;
+        const auto lo = static_cast<int>(bucket_lower_ms(b));
+        if (b + 1 < num_buckets)
+          oss_b << std::setw(5) << lo << " - " << std::setw(4) << static_cast<int>(bucket_lower_ms(b + 1)) << " ms ";
+        else
+          oss_b << std::setw(5) << lo << " -      ms ";
+        const int len = max_count > 0 ? static_cast<int>(counts[b]*bar_width / max_count) : 0;
+        oss_b << std::string(len, '#') << std::string(bar_width - len, ' ') << " " << counts[b];
+        lines.emplace_back(oss_b.str());
+      }
+      return lines;
+    }
+
+  private:
+    static double bucket_lower_ms(int bucket) { return bucket == 0 ? 0. : static_cast<double>(1 << (bucket - 1)); }
+
+    std::array<uint64_t, num_buckets> counts {};
+    uint64_t num_samples = 0;
+    double max_ms = 0.;
+    std::vector<double> recent;
+  };
+
+}
@@ -0,0 +1,493 @@
+//
+//  LivePreview.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#endif
+
+
+namespace textur
+{
+
+  // Live preview protocol over a Unix domain socket (stream). Every message is:
+  //   u32 payload_size
+  //   u8  type                          0 = snapshot (replaces everything), 1 = delta
+  //   i32 num_rows, i32 num_cols        size of the whole texture
+  //   u32 palette_offset, u32 palette_count
+  //   palette_count x { u16 len, char str[len] }   color strings as in Color::str()
+  //   u32 num_cells
+  //   num_cells x LivePreviewCell
+  // The palette grows over the session. A snapshot starts it over from offset 0 and a delta
+  //   only carries the colors that are new since the previous message.
+  // Large textures are sent in row bands: the snapshot message only holds the first rows and
+  //   the rest follow as deltas over the next frames.
+  // All integers are in host byte order since both ends are on the same machine.
+  enum class LivePreviewMsgType : uint8_t { Snapshot = 0, Delta = 1 };
+
+#pragma pack(push, 1)
+  struct LivePreviewCell
+  {
+    int32_t r;
+    int32_t c;
+    uint32_t preferred;
+    char fallback;
+    uint16_t fg;
+    uint16_t bg;
+    uint8_t mat_raw;
+  };
+#pragma pack(pop)
+
+  namespace live_preview
+  {
+    template<typename T>
+    void append_pod(std::string& buf, const T& val) { buf.append(reinterpret_cast<const char*>(&val), sizeof(T)); }
+
+    template<typename T>
+    bool read_pod(const std::string& buf, size_t& offs, T& val)
+    {
+      if (offs + sizeof(T) > buf.size())
+        return false;
+      std::memcpy(&val, buf.data() + offs, sizeof(T));
+      offs += sizeof(T);
+      return true;
+    }
+  }
+
+  // Publishes the edits of each frame as one batch of cell deltas to all connected viewers.
+  // Edited cells are collected with mark_dirty() and sent by flush(), which also accepts
+  //   new viewers and sends them a snapshot first. Sockets are non-blocking and a viewer that
+  //   falls too far behind is disconnected rather than stalling the editor.
+  // A snapshot goes out one band of rows per frame, and the next band only once the viewer
+  //   has read the previous one, so that resending a large texture never piles up. An edit
+  //   bigger than a band is resent the same way instead of as one delta.
+  class LivePreviewPublisher
+  {
+  public:
+    ~LivePreviewPublisher() { close(); }
+
+    bool open(const std::string& a_socket_path)
+    {
+#ifdef _WIN32
+      (void)a_socket_path;
+      return false;
+#else
+      socket_path = a_socket_path;
+      sockaddr_un addr {};
+      if (socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+      addr.sun_family = AF_UNIX;
+      std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+      ::unlink(socket_path.c_str());
+      listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (listen_fd < 0)
+        return false;
+      if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+          || ::listen(listen_fd, 8) != 0)
+      {
+        close();
+        return false;
+      }
+      set_non_blocking(listen_fd);
+      return true;
+#endif
+    }
+
+    bool is_open() const { return listen_fd >= 0; }
+    int num_viewers() const { return static_cast<int>(viewers.size()); }
+
+    void mark_dirty(const t8::RC& pos)
+    {
+      if (is_open() && !resync)
+        dirty.emplace(static_cast<uint64_t>(static_cast<uint32_t>(pos.r)) << 32 | static_cast<uint32_t>(pos.c));
+    }
+
+    // For large edits such as fills, which would otherwise put every cell in the hash set.
+    void mark_dirty(const t8::RC& pos, const t8::RC& size)
+    {
+      if (is_open() && !resync && size.r > 0 && size.c > 0)
+        dirty_rects.push_back({ pos, size });
+    }
+
+    // Everything is resent, e.g. when a layer is shown or hidden.
+    void mark_all_dirty() { resync = true; }
+
+    // get_textel(r, c) returns the textel to publish for a cell.
+    template<typename GetTextel>
+    void flush(const t8::RC& size, GetTextel&& get_textel)
+    {
+#ifndef _WIN32
+      if (!is_open())
+        return;
+      accept_viewers();
+      if (!(size == last_size))
+        resync = true;
+      last_size = size;
+
+      size_t num_dirty = dirty.size();
+      for (const auto& [pos, rect_size] : dirty_rects)
+        num_dirty += static_cast<size_t>(rect_size.r)*rect_size.c;
+      if (num_dirty*sizeof(LivePreviewCell) > snapshot_band_bytes)
+        resync = true;
+
+      if (resync)
+      {
+        for (auto& viewer : viewers)
+          viewer.snapshot_row = 0;
+        dirty.clear();
+        dirty_rects.clear();
+        resync = false;
+      }
+      drop_closed_viewers();
+
+      std::vector<LivePreviewCell> delta_cells;
+      if (!dirty.empty() || !dirty_rects.empty())
+      {
+        auto in_rect = [this](int r, int c)
+        {
+          for (const auto& [pos, rect_size] : dirty_rects)
+            if (pos.r <= r && r < pos.r + rect_size.r && pos.c <= c && c < pos.c + rect_size.c)
+              return true;
+          return false;
+        };
+        delta_cells.reserve(num_dirty);
+        for (const auto key : dirty)
+        {
+          const int r = static_cast<int32_t>(key >> 32);
+          const int c = static_cast<int32_t>(key & 0xFFFFFFFFu);
+          if (r < size.r && c < size.c && !in_rect(r, c))
+            delta_cells.emplace_back(make_cell(r, c, get_textel(r, c)));
+        }
+        // Overlapping rects are sent twice, which the viewer doesn't mind.
+        for (const auto& [pos, rect_size] : dirty_rects)
+          for (int r = std::max(0, pos.r); r < std::min(size.r, pos.r + rect_size.r); ++r)
+            for (int c = std::max(0, pos.c); c < std::min(size.c, pos.c + rect_size.c); ++c)
+              delta_cells.emplace_back(make_cell(r, c, get_textel(r, c)));
+        dirty.clear();
+        dirty_rects.clear();
+      }
+
+      const int band_rows = std::max(1, static_cast<int>(snapshot_band_bytes/sizeof(LivePreviewCell))
+                                        / std::max(1, size.c));
+      std::vector<LivePreviewCell> band_cells;
+      for (auto& viewer : viewers)
+      {
+        // A viewer that hasn't got the first band yet has nothing to apply the delta to, and
+        //   rows that are still to come are read when their band is sent.
+        if (viewer.snapshot_row != 0 && !delta_cells.empty())
+        {
+          viewer.outbox += encode(LivePreviewMsgType::Delta, size, viewer.palette_sent, delta_cells);
+          viewer.palette_sent = palette.size();
+        }
+        if (viewer.snapshot_row >= 0 && viewer.outbox.size() < snapshot_band_bytes)
+        {
+          const int r0 = viewer.snapshot_row;
+          const int r1 = std::min(size.r, r0 + band_rows);
+          band_cells.clear();
+          band_cells.reserve(static_cast<size_t>(r1 - r0)*size.c);
+          for (int r = r0; r < r1; ++r)
+            for (int c = 0; c < size.c; ++c)
+              band_cells.emplace_back(make_cell(r, c, get_textel(r, c)));
+          if (r0 == 0)
+            viewer.outbox += encode(LivePreviewMsgType::Snapshot, size, 0, band_cells);
+          else
+            viewer.outbox += encode(LivePreviewMsgType::Delta, size, viewer.palette_sent, band_cells);
+          viewer.palette_sent = palette.size();
+          viewer.snapshot_row = r1 < size.r ? r1 : -1;
+        }
+        send_pending(viewer);
+      }
+      viewers.erase(std::remove_if(viewers.begin(), viewers.end(), [](const auto& v) { return v.fd < 0; }),
+                    viewers.end());
+#else
+      (void)size;
+      (void)get_textel;
+#endif
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+      for (auto& viewer : viewers)
+        ::close(viewer.fd);
+      viewers.clear();
+      if (listen_fd >= 0)
+      {
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+      }
+#endif
+      listen_fd = -1;
+    }
+
+  private:
+    // Size of a snapshot band and of the largest edit that is sent as a delta.
+    static constexpr size_t snapshot_band_bytes = 4*1024*1024;
+    // A viewer that has this much unsent data is considered stuck. Snapshot bands wait for the
+    //   outbox to drain, so only deltas count up to this.
+    static constexpr size_t max_outbox_bytes = 64*1024*1024;
+
+    struct Viewer
+    {
+      int fd = -1;
+      int snapshot_row = 0; // Next row of the snapshot to send, -1 when there is none.
+      size_t palette_sent = 0;
+      std::string outbox;
+    };
+
+    LivePreviewCell make_cell(int r, int c, const t8::Textel& textel)
+    {
+      return { r, c, static_cast<uint32_t>(textel.glyph.preferred), textel.glyph.fallback,
+               color_index(textel.fg_color), color_index(textel.bg_color), textel.mat_raw };
+    }
+
+    uint16_t color_index(const t8::Color& color)
+    {
+      const int idx = color.get_index();
+      auto it = palette_lookup.find(idx);
+      if (it != palette_lookup.end())
+        return it->second;
+      const auto pal_idx = static_cast<uint16_t>(palette.size());
+      palette.emplace_back(color.str());
+      palette_lookup.emplace(idx, pal_idx);
+      return pal_idx;
+    }
+
+    std::string encode(LivePreviewMsgType type, const t8::RC& size, size_t palette_offset,
+                       const std::vector<LivePreviewCell>& cells) const
+    {
+      using live_preview::append_pod;
+      std::string payload;
+      payload.reserve(32 + cells.size()*sizeof(LivePreviewCell));
+      append_pod(payload, static_cast<uint8_t>(type));
+      append_pod(payload, static_cast<int32_t>(size.r));
+      append_pod(payload, static_cast<int32_t>(size.c));
+      append_pod(payload, static_cast<uint32_t>(palette_offset));
+      append_pod(payload, static_cast<uint32_t>(palette.size() - palette_offset));
+      for (size_t i = palette_offset; i < palette.size(); ++i)
+      {
+        append_pod(payload, static_cast<uint16_t>(palette[i].size()));
+        payload += palette[i];
+      }
+      append_pod(payload, static_cast<uint32_t>(cells.size()));
+      payload.append(reinterpret_cast<const char*>(cells.data()), cells.size()*sizeof(LivePreviewCell));
+      std::string msg;
+      append_pod(msg, static_cast<uint32_t>(payload.size()));
+      return msg + payload;
+    }
+
+#ifndef _WIN32
+    static void set_non_blocking(int fd) { ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK); }
+
+    void accept_viewers()
+    {
+      for (int fd = ::accept(listen_fd, nullptr, nullptr); fd >= 0; fd = ::accept(listen_fd, nullptr, nullptr))
+      {
+        set_non_blocking(fd);
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        viewers.push_back({ fd, 0, 0, {} });
+      }
+    }
+
+    // Viewers don't send anything, so readable means closed.
+    void drop_closed_viewers()
+    {
+      for (auto& viewer : viewers)
+      {
+        char buf[256];
+        const auto n = ::recv(viewer.fd, buf, sizeof(buf), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+          drop(viewer);
+      }
+      viewers.erase(std::remove_if(viewers.begin(), viewers.end(), [](const auto& v) { return v.fd < 0; }),
+                    viewers.end());
+    }
+
+    void send_pending(Viewer& viewer)
+    {
+#ifdef MSG_NOSIGNAL
+      constexpr int flags = MSG_NOSIGNAL;
+#else
+      constexpr int flags = 0;
+#endif
+      size_t sent = 0;
+      while (sent < viewer.outbox.size())
+      {
+        const auto n = ::send(viewer.fd, viewer.outbox.data() + sent, viewer.outbox.size() - sent, flags);
+        if (n > 0)
+          sent += static_cast<size_t>(n);
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          break;
+        else
+        {
+          drop(viewer);
+          return;
+        }
+      }
+      viewer.outbox.erase(0, sent);
+      if (viewer.outbox.size() > max_outbox_bytes)
+        drop(viewer);
+    }
+
+    static void drop(Viewer& viewer)
+    {
+      ::close(viewer.fd);
+      viewer.fd = -1;
+      viewer.outbox.clear();
+    }
+#endif
+
+    std::string socket_path;
+    int listen_fd = -1;
+    std::vector<Viewer> viewers;
+    std::unordered_set<uint64_t> dirty;
+    std::vector<std::pair<t8::RC, t8::RC>> dirty_rects;
+    bool resync = false;
+    t8::RC last_size { 0, 0 };
+    std::vector<std::string> palette;
+    std::unordered_map<int, uint16_t> palette_lookup;
+  };
+
+  // Viewer side of the protocol. Keeps the received texture up to date.
+  class LivePreviewReader
+  {
+  public:
+    ~LivePreviewReader()
+    {
+#ifndef _WIN32
+      if (fd >= 0)
+        ::close(fd);
+#endif
+    }
+
+    bool connect(const std::string& socket_path)
+    {
+#ifdef _WIN32
+      (void)socket_path;
+      return false;
+#else
+      sockaddr_un addr {};
+      if (socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+      addr.sun_family = AF_UNIX;
+      std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+      fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      return fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+#endif
+    }
+
+    // False if nothing arrives within timeout_ms.
+    bool wait(int timeout_ms) const
+    {
+#ifdef _WIN32
+      (void)timeout_ms;
+      return false;
+#else
+      pollfd pfd { fd, POLLIN, 0 };
+      return ::poll(&pfd, 1, timeout_ms) != 0;
+#endif
+    }
+
+    // Blocks until a whole message has arrived and applies it to texture.
+    // Returns false when the editor has gone away or the message is malformed.
+    bool receive(t8::Texture& texture, LivePreviewMsgType& type, int& num_cells)
+    {
+      uint32_t payload_size = 0;
+      std::string buf;
+      if (!read_exact(sizeof(payload_size), buf))
+        return false;
+      std::memcpy(&payload_size, buf.data(), sizeof(payload_size));
+      if (!read_exact(payload_size, buf))
+        return false;
+      return decode(buf, texture, type, num_cells);
+    }
+
+    bool decode(const std::string& payload, t8::Texture& texture, LivePreviewMsgType& type, int& num_cells)
+    {
+      using live_preview::read_pod;
+      size_t offs = 0;
+      uint8_t type_raw = 0;
+      int32_t num_rows = 0, num_cols = 0;
+      uint32_t palette_offset = 0, palette_count = 0, cell_count = 0;
+      if (!read_pod(payload, offs, type_raw) || !read_pod(payload, offs, num_rows) || !read_pod(payload, offs, num_cols)
+          || !read_pod(payload, offs, palette_offset) || !read_pod(payload, offs, palette_count))
+        return false;
+      type = static_cast<LivePreviewMsgType>(type_raw);
+      if (palette_offset > palette.size())
+        return false;
+      palette.resize(palette_offset);
+      for (uint32_t i = 0; i < palette_count; ++i)
+      {
+        uint16_t len = 0;
+        if (!read_pod(payload, offs, len) || offs + len > payload.size())
+          return false;
+        palette.emplace_back();
+        palette.back().parse(payload.substr(offs, len));
+        offs += len;
+      }
+      if (!read_pod(payload, offs, cell_count) || offs + cell_count*sizeof(LivePreviewCell) > payload.size())
+        return false;
+      if (type == LivePreviewMsgType::Snapshot || texture.size.r != num_rows || texture.size.c != num_cols)
+        texture = t8::Texture { { num_rows, num_cols } };
+      for (uint32_t i = 0; i < cell_count; ++i)
+      {
+        LivePreviewCell cell;
+        read_pod(payload, offs, cell);
+        if (cell.r < 0 || cell.r >= num_rows || cell.c < 0 || cell.c >= num_cols
+            || cell.fg >= palette.size() || cell.bg >= palette.size())
+          continue;
+        t8::Textel textel;
+        textel.glyph = t8::Glyph { static_cast<char32_t>(cell.preferred), cell.fallback };
+        textel.fg_color = palette[cell.fg];
+        textel.bg_color = palette[cell.bg];
+        textel.mat_raw = cell.mat_raw;
+        texture.set_textel(cell.r, cell.c, textel);
+      }
+      num_cells = static_cast<int>(cell_count);
+      return true;
+    }
+
+  private:
+    bool read_exact(size_t num_bytes, std::string& buf)
+    {
+#ifdef _WIN32
+      (void)num_bytes;
+      (void)buf;
+      return false;
+#else
+      buf.resize(num_bytes);
+      size_t got = 0;
+      while (got < num_bytes)
+      {
+        const auto n = ::recv(fd, buf.data() + got, num_bytes - got, 0);
+        if (n <= 0)
+          return false;
+        got += static_cast<size_t>(n);
+      }
+      return true;
+#endif
+    }
+
+    int fd = -1;
+    std::vector<t8::Color> palette;
+  };
+
+}
@@ -0,0 +1,157 @@
+//
+//  MaterialOccupancy.h
+//  TextUR
+//
+
+#pragma once
+#include "CompactRegion.h"
+#include <Termin8or/drawing/Texture.h>
+#include <Termin8or/geom/RC.h>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <bit>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // One occupancy bitmap per raw material over the cells of a texture.
+  // Bitmaps are only allocated for materials that have been seen so far.
+  class MaterialOccupancy
+  {
+  public:
+    void rebuild(const t8::Texture& texture)
+    {
+      size = texture.size;
+      num_words = (size.r*size.c + 63)/64;
+      for (auto& bm : bitmaps)
+        bm.clear();
+      counts.fill(0);
+      for (int r = 0; r < size.r; ++r)
+        for (int c = 0; c < size.c; ++c)
+          set_bit(texture(r, c).mat_raw, r*size.c + c);
+    }
+    
+    void update(const t8::RC& pos, uint8_t old_mat, uint8_t new_mat)
+    {
+      if (old_mat == new_mat || !in_range(pos))
+        return;
+      const int idx = pos.r*size.c + pos.c;
+      clear_bit(old_mat, idx);
+      set_bit(new_mat, idx);
+    }
+    
+    // Call after the cells of old_region have been overwritten with new_region at pos.
+    // Fills mostly change the material of a cell, and whether they do is hard to predict,
+    //   so the bit is always moved, which leaves it as it was when the two are the same.
+    void update_region(const t8::RC& pos, const CompactRegion& old_region, const CompactRegion& new_region)
+    {
+      const int r_end = std::min(old_region.size().r, size.r - pos.r);
+      const int c_end = std::min(old_region.size().c, size.c - pos.c);
+      if (pos.r < 0 || pos.c < 0 || r_end <= 0 || c_end <= 0)
+        return;
+      std::vector<uint8_t> old_mats(old_region.size().c);
+      std::vector<uint8_t> new_mats(new_region.size().c);
+      for (int r = 0; r < r_end; ++r)
+      {
+        old_region.for_each_in_row(r, [&](int c, const t8::Textel& textel) { old_mats[c] = textel.mat_raw; });
+        new_region.for_each_in_row(r, [&](int c, const t8::Textel& textel) { new_mats[c] = textel.mat_raw; });
+        const int idx0 = (pos.r + r)*size.c + pos.c;
+        for (int c = 0; c < c_end; ++c)
+        {
+          auto& old_bm = bitmaps[old_mats[c]];
+          auto& new_bm = bitmaps[new_mats[c]];
+          if (old_bm.empty() || new_bm.empty())
+          {
+            update({ pos.r + r, pos.c + c }, old_mats[c], new_mats[c]);
+            continue;
+          }
+          const int idx = idx0 + c;
+          old_bm[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+          new_bm[idx / 64] |= uint64_t(1) << (idx % 64);
+          counts[old_mats[c]]--;
+          counts[new_mats[c]]++;
+        }
+      }
+    }
+    
+    int count(uint8_t mat) const { return counts[mat]; }
+    
+    bool test(uint8_t mat, const t8::RC& pos) const
+    {
+      if (!in_range(pos) || bitmaps[mat].empty())
+        return false;
+      const int idx = pos.r*size.c + pos.c;
+      return (bitmaps[mat][idx / 64] >> (idx % 64)) & 1;
+    }
+    
+    // Finds the next cell after from (row-major, wrapping around) with material mat.
+    bool find_next(uint8_t mat, const t8::RC& from, t8::RC& pos) const
+    {
+      const auto& bm = bitmaps[mat];
+      if (counts[mat] == 0 || bm.empty())
+        return false;
+      const int num_cells = size.r*size.c;
+      const int start = in_range(from) ? (from.r*size.c + from.c + 1) % num_cells : 0;
+      // Scan [start, end) then wrap around to [0, start).
+      auto scan = [&](int idx0, int idx1, int& found)
+      {
+        for (int w = idx0 / 64; w < num_words && w*64 < idx1; ++w)
+        {
+          uint64_t word = bm[w];
+          if (w == idx0 / 64)
+            word &= ~uint64_t(0) << (idx0 % 64);
+          if (word == 0)
+            continue;
+          const int idx = w*64 + std::countr_zero(word);
+          if (idx < idx1)
+          {
+            found = idx;
+            return true;
+          }
+          return false;
+        }
+        return false;
+      };
+      int idx = -1;
+      if (scan(start, num_cells, idx) || scan(0, start, idx))
+      {
+        pos = { idx / size.c, idx % size.c };
+        return true;
+      }
+      return false;
+    }
+    
+  private:
+    bool in_range(const t8::RC& pos) const
+    {
+      return 0 <= pos.r && pos.r < size.r && 0 <= pos.c && pos.c < size.c;
+    }
+  
+    void set_bit(uint8_t mat, int idx)
+    {
+      auto& bm = bitmaps[mat];
+      if (bm.empty())
+        bm.resize(num_words, 0);
+      bm[idx / 64] |= uint64_t(1) << (idx % 64);
+      counts[mat]++;
+    }
+    
+    void clear_bit(uint8_t mat, int idx)
+    {
+      auto& bm = bitmaps[mat];
+      if (bm.empty())
+        return;
+      bm[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+      counts[mat]--;
+    }
+  
+    t8::RC size { 0, 0 };
+    int num_words = 0;
+    std::array<std::vector<uint64_t>, 256> bitmaps;
+    std::array<int, 256> counts {};
+  };
+
+}
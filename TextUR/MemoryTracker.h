@@ -0,0 +1,158 @@
+//
+//  MemoryTracker.h
+//  TextUR
+//
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // What an allocation is held by. Allocations made outside of any MemScope go to Other.
+  enum class MemTag : uint8_t { Other, Textures, Tracing, Bright, UndoRedo, Presets, UsedTextels, ViewCache, NUM_ITEMS };
+
+  inline const char* to_string(MemTag tag)
+  {
+    switch (tag)
+    {
+      case MemTag::Other: return "other";
+      case MemTag::Textures: return "textures (all layers)";
+      case MemTag::Tracing: return "tracing texture";
+      case MemTag::Bright: return "bright texture";
+      case MemTag::UndoRedo: return "undo / redo buffers";
+      case MemTag::Presets: return "textel presets";
+      case MemTag::UsedTextels: return "used textels";
+      case MemTag::ViewCache: return "viewport cache";
+      default: return "";
+    }
+  }
+
+  namespace memory_tracker
+  {
+    constexpr int num_tags = static_cast<int>(MemTag::NUM_ITEMS);
+    inline std::atomic<int64_t> bytes[num_tags] {};
+    inline std::atomic<int64_t> count[num_tags] {};
+    inline thread_local MemTag curr_tag = MemTag::Other;
+
+    // Every block starts with a header holding its size and tag so that it is
+    //   credited back to the right tag when freed. The header size keeps the alignment.
+    struct Header
+    {
+      size_t size;
+      MemTag tag;
+    };
+    constexpr size_t header_size =
+      (sizeof(Header) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)*alignof(std::max_align_t);
+
+    inline void* allocate(size_t size) noexcept
+    {
+      auto* block = static_cast<unsigned char*>(std::malloc(header_size + size));
+      if (block == nullptr)
+        return nullptr;
+      auto* header = reinterpret_cast<Header*>(block);
+      header->size = size;
+      header->tag = curr_tag;
+      const int t = static_cast<int>(header->tag);
+      bytes[t].fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+      count[t].fetch_add(1, std::memory_order_relaxed);
+      return block + header_size;
+    }
+
+    inline void deallocate(void* ptr) noexcept
+    {
+      if (ptr == nullptr)
+        return;
+      auto* block = static_cast<unsigned char*>(ptr) - header_size;
+      const auto* header = reinterpret_cast<const Header*>(block);
+      const int t = static_cast<int>(header->tag);
+      bytes[t].fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+      count[t].fetch_sub(1, std::memory_order_relaxed);
+      std::free(block);
+    }
+
+    inline int64_t get_bytes(MemTag tag) { return bytes[static_cast<int>(tag)].load(std::memory_order_relaxed); }
+    inline int64_t get_count(MemTag tag) { return count[static_cast<int>(tag)].load(std::memory_order_relaxed); }
+  }
+
+  // Allocations on this thread are credited to tag for the lifetime of the scope.
+  class MemScope
+  {
+  public:
+    explicit MemScope(MemTag tag) : prev_tag(memory_tracker::curr_tag) { memory_tracker::curr_tag = tag; }
+    ~MemScope() { memory_tracker::curr_tag = prev_tag; }
+    MemScope(const MemScope&) = delete;
+    MemScope& operator=(const MemScope&) = delete;
+
+  private:
+    MemTag prev_tag;
+  };
+
+  // Credits all allocations of a container to tag, wherever they happen.
+  template<typename T, MemTag tag>
+  struct TagAllocator
+  {
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = TagAllocator<U, tag>; };
+
+    TagAllocator() = default;
+    template<typename U>
+    TagAllocator(const TagAllocator<U, tag>&) {}
+
+    T* allocate(size_t n)
+    {
+      MemScope scope { tag };
+      return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+    void deallocate(T* ptr, size_t) { ::operator delete(ptr); }
+
+    template<typename U>
+    bool operator==(const TagAllocator<U, tag>&) const { return true; }
+    template<typename U>
+    bool operator!=(const TagAllocator<U, tag>&) const { return false; }
+  };
+
+  // One line per tag and one for the total.
+  constexpr int num_memory_report_lines = memory_tracker::num_tags + 1;
+
+  inline std::vector<std::string> format_memory_report()
+  {
+    auto format_bytes = [](int64_t b)
+    {
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(b < 1024*1024 ? 1 : 2);
+      if (b < 1024*1024)
+        oss << b/1024. << " KiB";
+      else
+        oss << b/(1024.*1024.) << " MiB";
+      return oss.str();
+    };
+    std::vector<std::string> lines;
+    int64_t total = 0;
+    for (int t = 0; t < memory_tracker::num_tags; ++t)
+    {
+      const auto tag = static_cast<MemTag>(t);
+      const auto b = memory_tracker::get_bytes(tag);
+      total += b;
+      std::ostringstream oss;
+      oss << std::left << std::setw(22) << to_string(tag) << std::right << std::setw(12) << format_bytes(b)
+          << std::setw(9) << memory_tracker::get_count(tag) << " allocs";
+      lines.emplace_back(oss.str());
+    }
+    std::ostringstream oss;
+    oss << std::left << std::setw(22) << "total" << std::right << std::setw(12) << format_bytes(total);
+    lines.emplace_back(oss.str());
+    return lines;
+  }
+
+}
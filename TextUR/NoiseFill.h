@@ -0,0 +1,250 @@
+//
+//  NoiseFill.h
+//  TextUR
+//
+
+#pragma once
+#include "CounterRng.h"
+#include <Termin8or/geom/RC.h>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+
+namespace textur
+{
+
+  // Multi-octave value noise. Every value is a pure function of the seed and the texture
+  //   coordinates, so neighbouring fills line up and a fill is reproducible from the seed.
+  // Rows count double since terminal cells are about twice as tall as wide, which keeps
+  //   the blobs round on screen.
+  class ValueNoise
+  {
+  public:
+    // Per octave, the first column in each lattice cell and the interpolation weight of each
+    //   column. They are the same on every row, so they are worked out once per fill.
+    struct Columns
+    {
+      int num_cols = 0;
+      std::vector<int64_t> ix0; // First lattice column per octave.
+      std::vector<std::vector<int>> cell_starts; // One past the last lattice cell is num_cols.
+      std::vector<std::vector<float>> w;
+    };
+    
+    // The lattice rows last used per octave. Coarse octaves span several texture rows, so
+    //   a thread that samples consecutive rows mostly finds them here. The bottom row is only
+    //   generated when a texture row falls between the two, which never happens for octaves
+    //   whose lattice rows are at most one texture row apart.
+    struct RowCache
+    {
+      std::vector<int64_t> iy;
+      std::vector<uint8_t> has_bottom;
+      std::vector<std::vector<float>> top;
+      std::vector<std::vector<float>> bottom;
+      std::vector<float> lattice;
+    };
+
+    ValueNoise(uint64_t seed, float a_scale, int a_num_octaves)
+      : scale(std::max(1.f, a_scale))
+      , num_octaves(std::clamp(a_num_octaves, 1, 16))
+    {
+      CounterRng rng { seed };
+      for (int octave = 0; octave < num_octaves; ++octave)
+        octave_keys[octave] = rng.bits(static_cast<uint64_t>(octave), 0);
+    }
+
+    Columns make_columns(int c0, int num_cols) const
+    {
+      Columns cols;
+      cols.num_cols = num_cols;
+      for (int octave = 0; octave < num_octaves; ++octave)
+      {
+        const float freq = frequency(octave);
+        const auto ix0 = static_cast<int64_t>(std::floor(c0*freq));
+        cols.ix0.emplace_back(ix0);
+        auto& cell_starts = cols.cell_starts.emplace_back();
+        auto& w = cols.w.emplace_back(num_cols);
+        for (int i = 0; i < num_cols; ++i)
+        {
+          const float x = (c0 + i)*freq;
+          const auto ix = static_cast<int64_t>(std::floor(x));
+          while (static_cast<int64_t>(cell_starts.size()) <= ix - ix0)
+            cell_starts.emplace_back(i);
+          w[i] = smoothstep(x - static_cast<float>(ix));
+        }
+        cell_starts.emplace_back(num_cols);
+      }
+      return cols;
+    }
+
+    // Noise in [0, 1) for the columns of cols on row r.
+    // Per row and octave, the two lattice rows around r are blended into one row of values,
+    //   after which each cell only costs one lerp per octave. The lerps run over one lattice
+    //   cell at a time so that the inner loop has no lookups and can be vectorized.
+    void sample_row(int r, const Columns& cols, RowCache& cache, float* out) const
+    {
+      constexpr auto no_row = std::numeric_limits<int64_t>::min();
+      if (cache.iy.empty())
+      {
+        cache.iy.assign(num_octaves, no_row);
+        cache.has_bottom.assign(num_octaves, 0);
+        cache.top.resize(num_octaves);
+        cache.bottom.resize(num_octaves);
+      }
+      std::fill(out, out + cols.num_cols, 0.f);
+      float amplitude = 1.f;
+      float amplitude_sum = 0.f;
+      for (int octave = 0; octave < num_octaves; ++octave)
+      {
+        const float y = 2.f*r*frequency(octave);
+        const auto iy = static_cast<int64_t>(std::floor(y));
+        const float ty = smoothstep(y - static_cast<float>(iy));
+        const auto ix0 = cols.ix0[octave];
+        const auto& cell_starts = cols.cell_starts[octave];
+        const int num_cells = static_cast<int>(cell_starts.size()) - 1;
+        auto& top = cache.top[octave];
+        auto& bottom = cache.bottom[octave];
+        if (cache.iy[octave] != iy)
+        {
+          if (cache.has_bottom[octave] && cache.iy[octave] != no_row && cache.iy[octave] + 1 == iy)
+            std::swap(top, bottom);
+          else
+          {
+            top.resize(num_cells + 1);
+            for (int j = 0; j <= num_cells; ++j)
+              top[j] = lattice_value(octave, ix0 + j, iy);
+          }
+          cache.iy[octave] = iy;
+          cache.has_bottom[octave] = 0;
+        }
+        if (ty > 0.f && !cache.has_bottom[octave])
+        {
+          bottom.resize(num_cells + 1);
+          for (int j = 0; j <= num_cells; ++j)
+            bottom[j] = lattice_value(octave, ix0 + j, iy + 1);
+          cache.has_bottom[octave] = 1;
+        }
+        auto& lattice = cache.lattice;
+        lattice.resize(num_cells + 1);
+        for (int j = 0; j <= num_cells; ++j)
+          lattice[j] = amplitude*(ty > 0.f ? top[j] + (bottom[j] - top[j])*ty : top[j]);
+        const float* w = cols.w[octave].data();
+        for (int j = 0; j < num_cells; ++j)
+        {
+          const float left = lattice[j];
+          const float diff = lattice[j + 1] - left;
+          for (int i = cell_starts[j]; i < cell_starts[j + 1]; ++i)
+            out[i] += left + diff*w[i];
+        }
+        amplitude_sum += amplitude;
+        amplitude *= 0.5f;
+      }
+      for (int i = 0; i < cols.num_cols; ++i)
+        out[i] = std::min(out[i] / amplitude_sum, 0.99999994f);
+    }
+
+  private:
+    static float smoothstep(float t) { return t*t*(3.f - 2.f*t); }
+
+    float frequency(int octave) const { return static_cast<float>(1 << octave) / scale; }
+
+    // A single SplitMix64 round over the lattice coordinates keyed by octave. The fine
+    //   octaves need a lattice value or two per cell, so this is a large part of the time
+    //   and the two rounds of CounterRng::bits() aren't needed for noise.
+    float lattice_value(int octave, int64_t ix, int64_t iy) const
+    {
+      uint64_t z = octave_keys[octave]
+        ^ (static_cast<uint64_t>(static_cast<uint32_t>(iy)) << 32 | static_cast<uint32_t>(ix))*0x9E3779B97F4A7C15ull;
+      z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+      z ^= z >> 31;
+      return static_cast<float>(z >> 40) * (1.f / 16777216.f);
+    }
+
+    std::array<uint64_t, 16> octave_keys {};
+    float scale = 8.f;
+    int num_octaves = 4;
+  };
+
+  // Splits the noise over a rectangle into num_choices bands of (about) equal area and
+  //   returns the band of each cell, row by row.
+  // Averaging octaves piles the values up around 0.5, so the band limits are taken as
+  //   quantiles of the noise in the rectangle rather than at equal intervals, which would
+  //   hardly ever pick the first and last choices. The quantiles come from a few evenly
+  //   spaced rows, after which the rows are evaluated and banded in parallel.
+  inline std::vector<uint8_t> noise_bands(const ValueNoise& noise, const t8::RC& pos, const t8::RC& size, int num_choices)
+  {
+    if (size.r <= 0 || size.c <= 0)
+      return {};
+    const auto cols = noise.make_columns(pos.c, size.c);
+    ValueNoise::RowCache cache;
+    std::vector<float> row(size.c);
+
+    std::vector<float> sample;
+    const int num_sample_rows = std::min(size.r, 32);
+    for (int i = 0; i < num_sample_rows; ++i)
+    {
+      noise.sample_row(pos.r + i*size.r / num_sample_rows, cols, cache, row.data());
+      sample.insert(sample.end(), row.begin(), row.end());
+    }
+    std::vector<float> limits;
+    // One sort rather than an nth_element() per limit, which adds up with 256 choices.
+    std::sort(sample.begin(), sample.end());
+    for (int b = 1; b < num_choices; ++b)
+      limits.emplace_back(sample[b*sample.size() / num_choices]);
+
+    // The band at the lower edge of each of num_buckets equal buckets of [0, 1]. A value in a
+    //   bucket whose two edges are in the same band is in that band too, so the binary search
+    //   is only needed in the few buckets that a band limit falls in. Scaling by a power of two
+    //   is exact, so the bucket of a value never disagrees with the search.
+    constexpr int num_buckets = 1 << 16;
+    auto band_of = [&limits](float val)
+    {
+      return static_cast<uint8_t>(std::upper_bound(limits.begin(), limits.end(), val) - limits.begin());
+    };
+    std::vector<uint8_t> bucket_bands(num_buckets + 1);
+    for (int b = 0; b <= num_buckets; ++b)
+      bucket_bands[b] = band_of(static_cast<float>(b) / num_buckets);
+
+    // Rows are handed out in chunks so that each thread gets to reuse its cached lattice rows.
+    std::vector<uint8_t> bands(static_cast<size_t>(size.r)*size.c);
+    constexpr int chunk_rows = 16;
+    std::atomic<int> next_row { 0 };
+    auto worker = [&]()
+    {
+      ValueNoise::RowCache worker_cache;
+      std::vector<float> worker_row(size.c);
+      for (int r0 = next_row.fetch_add(chunk_rows); r0 < size.r; r0 = next_row.fetch_add(chunk_rows))
+      {
+        const int r1 = std::min(size.r, r0 + chunk_rows);
+        for (int r = r0; r < r1; ++r)
+        {
+          noise.sample_row(pos.r + r, cols, worker_cache, worker_row.data());
+          auto* out = bands.data() + static_cast<size_t>(r)*size.c;
+          for (int c = 0; c < size.c; ++c)
+          {
+            const auto b = static_cast<int>(worker_row[c]*num_buckets);
+            const auto band = bucket_bands[b];
+            out[c] = band == bucket_bands[b + 1] ? band : band_of(worker_row[c]);
+          }
+        }
+      }
+    };
+    const int num_threads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()),
+                                                 (size.r + chunk_rows - 1) / chunk_rows));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; ++t)
+      threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+      thread.join();
+    return bands;
+  }
+
+
+}
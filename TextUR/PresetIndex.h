@@ -0,0 +1,248 @@
+//
+//  PresetIndex.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  struct TextelHash
+  {
+    size_t operator()(const t8::Textel& textel) const
+    {
+      uint64_t h = static_cast<uint64_t>(textel.glyph.preferred);
+      h = h*31 + static_cast<uint64_t>(static_cast<unsigned char>(textel.glyph.fallback));
+      h = h*31 + static_cast<uint64_t>(textel.fg_color.get_index());
+      h = h*31 + static_cast<uint64_t>(textel.bg_color.get_index());
+      h = h*31 + static_cast<uint64_t>(textel.mat_raw);
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDull;
+      h ^= h >> 33;
+      return static_cast<size_t>(h);
+    }
+  };
+
+  // Hashed lookup of textel presets by their normal or shadow textel.
+  // Preset 0 is the Ad Hoc preset, which changes all the time, so it is always
+  //   checked directly instead of being part of the hash tables.
+  // Lookups return the same index as a linear search from the start of the list would.
+  template<typename TextelItem>
+  class PresetIndex
+  {
+  public:
+    void rebuild(const std::vector<TextelItem>& presets)
+    {
+      normal_map.clear();
+      shadow_map.clear();
+      normal_map.reserve(presets.size());
+      shadow_map.reserve(presets.size());
+      for (int idx = 1; idx < static_cast<int>(presets.size()); ++idx)
+      {
+        normal_map.try_emplace(presets[idx].textel_normal, idx);
+        shadow_map.try_emplace(presets[idx].textel_shadow, idx);
+      }
+    }
+    
+    // Call after preset idx has been edited (old holds what it was) or appended (old is nullptr).
+    void patch(const std::vector<TextelItem>& presets, int idx, const TextelItem* old)
+    {
+      for (bool shadow : { false, true })
+      {
+        auto& map = shadow ? shadow_map : normal_map;
+        if (old != nullptr)
+        {
+          auto it = map.find(old->get_textel(shadow));
+          if (it != map.end() && it->second == idx)
+          {
+            // Any other preset with the same textel comes later in the list.
+            map.erase(it);
+            const int n = static_cast<int>(presets.size());
+            for (int other_idx = idx + 1; other_idx < n; ++other_idx)
+              if (presets[other_idx].get_textel(shadow) == old->get_textel(shadow))
+              {
+                map.emplace(old->get_textel(shadow), other_idx);
+                break;
+              }
+          }
+        }
+        auto [it, inserted] = map.try_emplace(presets[idx].get_textel(shadow), idx);
+        if (!inserted && idx < it->second)
+          it->second = idx;
+      }
+    }
+    
+    int find_normal(const std::vector<TextelItem>& presets, const t8::Textel& textel) const
+    {
+      return find(presets, textel, false);
+    }
+    
+    int find_shadow(const std::vector<TextelItem>& presets, const t8::Textel& textel) const
+    {
+      return find(presets, textel, true);
+    }
+    
+    // Matches against normal textels first and then against shadow textels.
+    int find_any(const std::vector<TextelItem>& presets, const t8::Textel& textel) const
+    {
+      const int idx = find_normal(presets, textel);
+      return 0 <= idx ? idx : find_shadow(presets, textel);
+    }
+    
+  private:
+    int find(const std::vector<TextelItem>& presets, const t8::Textel& textel, bool shadow) const
+    {
+      if (!presets.empty() && presets[0].get_textel(shadow) == textel)
+        return 0;
+      const auto& map = shadow ? shadow_map : normal_map;
+      auto it = map.find(textel);
+      return it != map.end() ? it->second : -1;
+    }
+  
+    std::unordered_map<t8::Textel, int, TextelHash> normal_map;
+    std::unordered_map<t8::Textel, int, TextelHash> shadow_map;
+  };
+  
+  // Groups consecutive presets that share the same material.
+  // The Ad Hoc preset (index 0) always forms a group of its own since its material can
+  //   change at any time without the index being rebuilt.
+  class MaterialGroupIndex
+  {
+  public:
+    template<typename TextelItem>
+    void rebuild(const std::vector<TextelItem>& presets)
+    {
+      const int n = static_cast<int>(presets.size());
+      mat_counts.fill(0);
+      for (int idx = 1; idx < n; ++idx)
+        mat_counts[presets[idx].textel_normal.mat_raw]++;
+      regroup(presets, 0);
+    }
+    
+    // Call after preset idx (not the Ad Hoc preset) has been edited (old_mat_raw holds its
+    //   previous raw material) or appended (old_mat_raw is -1).
+    // The groups are left alone unless the material changed, and then only the groups from the
+    //   one before idx and onwards are redone, which for custom presets is the tail of the list.
+    template<typename TextelItem>
+    void patch(const std::vector<TextelItem>& presets, int idx, int old_mat_raw)
+    {
+      const auto mat_raw = presets[idx].textel_normal.mat_raw;
+      if (old_mat_raw == mat_raw)
+        return;
+      if (old_mat_raw >= 0)
+        mat_counts[old_mat_raw]--;
+      mat_counts[mat_raw]++;
+      const int prev_idx = std::min(idx, static_cast<int>(group_of.size()) - 1);
+      regroup(presets, std::max(0, group_of[prev_idx] - 1));
+    }
+    
+    int num_groups() const { return static_cast<int>(group_materials.size()); }
+    int group(int preset_idx) const { return group_of[preset_idx]; }
+    int group_start(int g) const { return group_starts[g]; }
+    int group_end(int g) const { return group_starts[g + 1]; }
+    int group_size(int g) const { return group_end(g) - group_start(g); }
+    int group_material(int g) const { return group_materials[g]; }
+    
+    // Number of presets (excluding the Ad Hoc preset) with raw material mat_raw.
+    int material_count(uint8_t mat_raw) const { return mat_counts[mat_raw]; }
+    
+    // Last preset of the previous group, or -1.
+    int prev_group_last(int preset_idx) const
+    {
+      const int g = group_of[preset_idx];
+      return g > 0 ? group_start(g) - 1 : -1;
+    }
+    
+    // First preset of the next group, or -1.
+    int next_group_start(int preset_idx) const
+    {
+      const int g = group_of[preset_idx];
+      return g + 1 < num_groups() ? group_start(g + 1) : -1;
+    }
+    
+  private:
+    // Redoes groups g0 and onwards.
+    template<typename TextelItem>
+    void regroup(const std::vector<TextelItem>& presets, int g0)
+    {
+      const int n = static_cast<int>(presets.size());
+      const int idx0 = g0 < static_cast<int>(group_materials.size()) ? group_starts[g0] : 0;
+      group_starts.resize(g0);
+      group_materials.resize(g0);
+      group_of.resize(n);
+      for (int idx = idx0; idx < n; ++idx)
+      {
+        const int mat = presets[idx].textel_normal.decode_raw_mat();
+        if (idx <= 1 || mat != group_materials.back())
+        {
+          group_starts.emplace_back(idx);
+          group_materials.emplace_back(mat);
+        }
+        group_of[idx] = static_cast<int>(group_starts.size()) - 1;
+      }
+      group_starts.emplace_back(n);
+    }
+  
+    std::vector<int> group_starts;
+    std::vector<int> group_materials;
+    std::vector<int> group_of;
+    std::array<int, 256> mat_counts {};
+  };
+  
+  // Most recently used list with constant time lookup and promotion to the front.
+  template<typename T, typename Hash>
+  class MruList
+  {
+  public:
+    explicit MruList(size_t a_capacity) : capacity(a_capacity) {}
+    
+    void set_capacity(size_t a_capacity)
+    {
+      capacity = a_capacity;
+      while (items.size() > capacity)
+        pop_back();
+    }
+    
+    void promote(const T& item)
+    {
+      auto it = lookup.find(item);
+      if (it != lookup.end())
+        items.splice(items.begin(), items, it->second);
+      else
+      {
+        items.push_front(item);
+        lookup.emplace(item, items.begin());
+        while (items.size() > capacity)
+          pop_back();
+      }
+    }
+    
+    const T& at(int idx) const { return *std::next(items.begin(), idx); }
+    
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    auto begin() const { return items.begin(); }
+    auto end() const { return items.end(); }
+    
+  private:
+    void pop_back()
+    {
+      lookup.erase(items.back());
+      items.pop_back();
+    }
+  
+    size_t capacity = 0;
+    std::list<T> items;
+    std::unordered_map<T, typename std::list<T>::iterator, Hash> lookup;
+  };
+
+}
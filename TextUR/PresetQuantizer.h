@@ -0,0 +1,260 @@
+//
+//  PresetQuantizer.h
+//  TextUR
+//
+
+#pragma once
+#include "PresetIndex.h"
+#include "AnsiExport.h"
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <limits>
+
+
+namespace textur
+{
+
+  // RGB of an entry in the 256 color xterm palette.
+  inline std::array<float, 3> ansi_palette_rgb(int palette_idx)
+  {
+    static constexpr std::array<std::array<float, 3>, 16> basic =
+    {{
+      { 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+      { 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+      { 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+      { 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 },
+    }};
+    static constexpr float levels[6] = { 0, 95, 135, 175, 215, 255 };
+    if (palette_idx < 16)
+      return basic[palette_idx];
+    if (palette_idx < 232)
+    {
+      const int i = palette_idx - 16;
+      return { levels[i / 36], levels[(i / 6) % 6], levels[i % 6] };
+    }
+    const float gray = static_cast<float>(8 + 10*(palette_idx - 232));
+    return { gray, gray, gray };
+  }
+
+  // Nearest neighbour search among points in (fg rgb, bg rgb) space with per axis weights.
+  // The points are kept in a flat array ordered as a balanced k-d tree, so there are no nodes to allocate.
+  class ColorKdTree
+  {
+  public:
+    using Point = std::array<float, 6>;
+
+    void build(std::vector<Point> a_points, std::vector<int> a_ids)
+    {
+      points = std::move(a_points);
+      ids = std::move(a_ids);
+      std::vector<int> order(points.size());
+      std::iota(order.begin(), order.end(), 0);
+      build_range(order, 0, static_cast<int>(order.size()), 0);
+      std::vector<Point> sorted_points;
+      std::vector<int> sorted_ids;
+      for (const int i : order)
+      {
+        sorted_points.emplace_back(points[i]);
+        sorted_ids.emplace_back(ids[i]);
+      }
+      points = std::move(sorted_points);
+      ids = std::move(sorted_ids);
+    }
+
+    // Ties go to the lowest id, i.e. the first preset in the list.
+    void nearest(const Point& query, const Point& weights, int& best_id, float& best_dist2) const
+    {
+      search(0, static_cast<int>(points.size()), 0, query, weights, best_id, best_dist2);
+    }
+
+  private:
+    void build_range(std::vector<int>& order, int lo, int hi, int depth)
+    {
+      if (hi - lo <= 1)
+        return;
+      const int mid = (lo + hi) / 2;
+      const int axis = depth % 6;
+      std::nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi,
+                       [&](int a, int b) { return points[a][axis] < points[b][axis]; });
+      build_range(order, lo, mid, depth + 1);
+      build_range(order, mid + 1, hi, depth + 1);
+    }
+
+    void search(int lo, int hi, int depth, const Point& query, const Point& weights,
+                int& best_id, float& best_dist2) const
+    {
+      if (lo >= hi)
+        return;
+      const int mid = (lo + hi) / 2;
+      const auto& p = points[mid];
+      float dist2 = 0.f;
+      for (int i = 0; i < 6; ++i)
+        dist2 += weights[i]*(p[i] - query[i])*(p[i] - query[i]);
+      if (dist2 < best_dist2 || (dist2 == best_dist2 && ids[mid] < best_id))
+      {
+        best_id = ids[mid];
+        best_dist2 = dist2;
+      }
+      const int axis = depth % 6;
+      const float diff = query[axis] - p[axis];
+      if (diff < 0.f)
+        search(lo, mid, depth + 1, query, weights, best_id, best_dist2);
+      else
+        search(mid + 1, hi, depth + 1, query, weights, best_id, best_dist2);
+      if (weights[axis]*diff*diff <= best_dist2)
+      {
+        if (diff < 0.f)
+          search(mid + 1, hi, depth + 1, query, weights, best_id, best_dist2);
+        else
+          search(lo, mid, depth + 1, query, weights, best_id, best_dist2);
+      }
+    }
+
+    std::vector<Point> points;
+    std::vector<int> ids;
+  };
+
+  struct QuantizeStats
+  {
+    size_t num_cells = 0; // Cells that were replaced by a preset.
+    size_t num_unique = 0; // Distinct textels that needed a search.
+    double seconds = 0.;
+  };
+
+  // Maps arbitrary textels (typically from imported ANSI art) to the normal textel of the
+  //   nearest textel preset, so that they get proper materials and can be converted with -c.
+  // The distance is the squared RGB distance of the fg and bg colors plus a penalty if the
+  //   glyphs differ. For blank glyphs only the bg color counts. Presets with the same glyph
+  //   are searched in a k-d tree of their own and all presets in a shared one, so a
+  //   different glyph only wins if its colors are closer by more than the penalty.
+  // Each distinct input textel is only searched for once, and art rarely has more than a few
+  //   thousand distinct textels however large it is.
+  // Blank cells with a default or transparent bg are left as they are.
+  template<typename TextelItem>
+  class PresetQuantizer
+  {
+  public:
+    // Squared RGB distance that a glyph mismatch costs, i.e. about 110 steps in a single channel.
+    static constexpr float glyph_penalty = 3.f*64.f*64.f;
+
+    PresetQuantizer(const std::vector<TextelItem>& a_presets, const t8::Color& default_fg, const t8::Color& default_bg)
+      : presets(a_presets)
+    {
+      const int default_fg_idx = ansi_palette_index(default_fg);
+      const int default_bg_idx = ansi_palette_index(default_bg);
+      default_fg_rgb = default_fg_idx < 0 ? ansi_palette_rgb(7) : ansi_palette_rgb(default_fg_idx);
+      default_bg_rgb = default_bg_idx < 0 ? ansi_palette_rgb(0) : ansi_palette_rgb(default_bg_idx);
+
+      std::vector<ColorKdTree::Point> all_points;
+      std::vector<int> all_ids;
+      std::unordered_map<char32_t, std::pair<std::vector<ColorKdTree::Point>, std::vector<int>>> glyph_points;
+      // Preset 0 is the Ad Hoc preset and isn't a real preset.
+      for (int idx = 1; idx < static_cast<int>(presets.size()); ++idx)
+      {
+        const auto& textel = presets[idx].textel_normal;
+        const auto point = to_point(textel);
+        all_points.emplace_back(point);
+        all_ids.emplace_back(idx);
+        auto& [points, ids] = glyph_points[glyph_key(textel.glyph)];
+        points.emplace_back(point);
+        ids.emplace_back(idx);
+      }
+      all_tree.build(std::move(all_points), std::move(all_ids));
+      for (auto& [glyph, points_ids] : glyph_points)
+        glyph_trees[glyph].build(std::move(points_ids.first), std::move(points_ids.second));
+    }
+
+    // Index of the nearest preset, or -1 if the textel is to be left as it is.
+    int find_nearest(const t8::Textel& textel)
+    {
+      auto it = cache.find(textel);
+      if (it != cache.end())
+        return it->second;
+      stats.num_unique++;
+
+      const auto key = glyph_key(textel.glyph);
+      if (is_blank_glyph(key) && ansi_palette_index(textel.bg_color) < 0)
+      {
+        cache.emplace(textel, -1);
+        return -1;
+      }
+      const auto query = to_point(textel);
+      ColorKdTree::Point weights;
+      weights.fill(1.f);
+      if (is_blank_glyph(key))
+        std::fill(weights.begin(), weights.begin() + 3, 0.f);
+
+      int best_id = std::numeric_limits<int>::max();
+      float best_dist2 = std::numeric_limits<float>::max();
+      auto it_glyph = glyph_trees.find(key);
+      if (it_glyph != glyph_trees.end())
+        it_glyph->second.nearest(query, weights, best_id, best_dist2);
+      // Comparing against best_dist2 - glyph_penalty instead of adding the penalty to every
+      //   distance of the shared tree gives the same result.
+      int other_id = std::numeric_limits<int>::max();
+      float other_dist2 = best_dist2 == std::numeric_limits<float>::max() ?
+        best_dist2 : best_dist2 - glyph_penalty;
+      all_tree.nearest(query, weights, other_id, other_dist2);
+      if (other_id != std::numeric_limits<int>::max()
+          && (best_id == std::numeric_limits<int>::max() || other_dist2 + glyph_penalty < best_dist2))
+        best_id = other_id;
+
+      const int preset_idx = best_id == std::numeric_limits<int>::max() ? -1 : best_id;
+      cache.emplace(textel, preset_idx);
+      return preset_idx;
+    }
+
+    void quantize(t8::Texture& texture)
+    {
+      const auto t0 = std::chrono::steady_clock::now();
+      for (int r = 0; r < texture.size.r; ++r)
+      {
+        for (int c = 0; c < texture.size.c; ++c)
+        {
+          const int preset_idx = find_nearest(texture(r, c));
+          if (0 <= preset_idx)
+          {
+            texture.set_textel(r, c, presets[preset_idx].textel_normal);
+            stats.num_cells++;
+          }
+        }
+      }
+      stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    const QuantizeStats& get_stats() const { return stats; }
+
+  private:
+    static char32_t glyph_key(const t8::Glyph& glyph)
+    {
+      if (glyph.preferred != t8::Glyph::none32)
+        return glyph.preferred;
+      return glyph.fallback != t8::Glyph::none ? static_cast<char32_t>(static_cast<unsigned char>(glyph.fallback)) : U' ';
+    }
+
+    static bool is_blank_glyph(char32_t key) { return key == U' ' || key == U'\u00A0'; }
+
+    ColorKdTree::Point to_point(const t8::Textel& textel) const
+    {
+      const int fg_idx = ansi_palette_index(textel.fg_color);
+      const int bg_idx = ansi_palette_index(textel.bg_color);
+      const auto fg = fg_idx < 0 ? default_fg_rgb : ansi_palette_rgb(fg_idx);
+      const auto bg = bg_idx < 0 ? default_bg_rgb : ansi_palette_rgb(bg_idx);
+      return { fg[0], fg[1], fg[2], bg[0], bg[1], bg[2] };
+    }
+
+    const std::vector<TextelItem>& presets;
+    std::array<float, 3> default_fg_rgb {};
+    std::array<float, 3> default_bg_rgb {};
+    ColorKdTree all_tree;
+    std::unordered_map<char32_t, ColorKdTree> glyph_trees;
+    std::unordered_map<t8::Textel, int, TextelHash> cache;
+    QuantizeStats stats;
+  };
+
+}
@@ -0,0 +1,206 @@
+//
+//  PresetSearch.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  // Type-to-filter search over the textel presets.
+  // A query matches a preset when it is a (case insensitive) prefix of its name or of
+  //   any word in its name, when it is a single character equal to the preset glyph or
+  //   when it is of the form "#<mat>" and the preset has material <mat>.
+  // The names are indexed in a table of lower case word suffixes of the name sorted
+  //   alphabetically, so a query is a binary search followed by a scan over the hits only.
+  class PresetSearch
+  {
+  public:
+    template<typename TextelItem>
+    void rebuild(const std::vector<TextelItem>& presets)
+    {
+      entries.clear();
+      glyph_map.clear();
+      mat_map.clear();
+      const int n = static_cast<int>(presets.size());
+      for (int idx = 0; idx < n; ++idx)
+      {
+        const auto& preset = presets[idx];
+        for_each_key(preset.name, [&](std::string key) { entries.push_back({ std::move(key), idx }); });
+        for_each_glyph_key(preset, [&](char32_t key) { add_unique(glyph_map[key], idx); });
+        mat_map[preset.textel_normal.decode_raw_mat()].emplace_back(idx);
+      }
+      std::sort(entries.begin(), entries.end(), key_less);
+      seen.assign(n, 0);
+      generation = 0;
+    }
+
+    // Call after preset idx has been edited (old holds what it was) or appended (old is nullptr).
+    // The entries of the old name are taken out and those of the new name are inserted at
+    //   their sorted positions, so nothing is sorted again.
+    template<typename TextelItem>
+    void patch(const std::vector<TextelItem>& presets, int idx, const TextelItem* old)
+    {
+      if (old != nullptr)
+      {
+        for_each_key(old->name, [&](std::string key)
+        {
+          auto [it_begin, it_end] = std::equal_range(entries.begin(), entries.end(), Entry { key, 0 }, key_less);
+          auto it = std::find_if(it_begin, it_end, [idx](const auto& e) { return e.preset_idx == idx; });
+          if (it != it_end)
+            entries.erase(it);
+        });
+        for_each_glyph_key(*old, [&](char32_t key) { erase_sorted(glyph_map[key], idx); });
+        erase_sorted(mat_map[old->textel_normal.decode_raw_mat()], idx);
+      }
+      const auto& preset = presets[idx];
+      for_each_key(preset.name, [&](std::string key)
+      {
+        Entry entry { std::move(key), idx };
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, key_less), std::move(entry));
+      });
+      for_each_glyph_key(preset, [&](char32_t key) { insert_sorted(glyph_map[key], idx); });
+      insert_sorted(mat_map[preset.textel_normal.decode_raw_mat()], idx);
+      if (seen.size() != presets.size())
+        seen.resize(presets.size(), 0);
+    }
+
+    // Fills result with the matching preset indices in ascending order.
+    // An empty query matches nothing.
+    void find(const std::string& query, std::vector<int>& result)
+    {
+      result.clear();
+      if (query.empty())
+        return;
+      if (++generation == 0)
+      {
+        std::fill(seen.begin(), seen.end(), 0);
+        generation = 1;
+      }
+      auto add = [&](int idx)
+      {
+        if (seen[idx] != generation)
+        {
+          seen[idx] = generation;
+          result.emplace_back(idx);
+        }
+      };
+
+      const auto q = to_lower(query);
+      auto it = std::lower_bound(entries.begin(), entries.end(), q,
+                                 [](const auto& e, const std::string& s) { return e.key < s; });
+      for (; it != entries.end() && it->key.compare(0, q.size(), q) == 0; ++it)
+        add(it->preset_idx);
+
+      if (query.size() == 1)
+      {
+        auto git = glyph_map.find(static_cast<char32_t>(static_cast<unsigned char>(query[0])));
+        if (git != glyph_map.end())
+          for (int idx : git->second)
+            add(idx);
+      }
+
+      if (query.size() >= 2 && query[0] == '#')
+      {
+        int mat = 0;
+        bool valid = true;
+        for (size_t i = 1; i < query.size(); ++i)
+        {
+          if (!std::isdigit(static_cast<unsigned char>(query[i])))
+          {
+            valid = false;
+            break;
+          }
+          mat = mat*10 + (query[i] - '0');
+        }
+        auto mit = valid ? mat_map.find(mat) : mat_map.end();
+        if (mit != mat_map.end())
+          for (int idx : mit->second)
+            add(idx);
+      }
+
+      std::sort(result.begin(), result.end());
+    }
+
+  private:
+    struct Entry
+    {
+      std::string key;
+      int preset_idx = 0;
+    };
+
+    static bool key_less(const Entry& a, const Entry& b) { return a.key < b.key; }
+
+    // The lower case suffixes of name that start a word.
+    template<typename F>
+    static void for_each_key(const std::string& preset_name, F&& f)
+    {
+      const auto name = to_lower(preset_name);
+      for (size_t i = 0; i < name.size(); ++i)
+        if (is_word_start(name, i))
+          f(name.substr(i));
+    }
+
+    template<typename TextelItem, typename F>
+    static void for_each_glyph_key(const TextelItem& preset, F&& f)
+    {
+      for (bool shadow : { false, true })
+      {
+        const auto& glyph = preset.get_textel(shadow).glyph;
+        f(static_cast<char32_t>(glyph.preferred));
+        if (glyph.fallback != t8::Glyph::none)
+          f(static_cast<char32_t>(static_cast<unsigned char>(glyph.fallback)));
+      }
+    }
+
+    static std::string to_lower(const std::string& str)
+    {
+      std::string ret = str;
+      for (auto& ch : ret)
+        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+      return ret;
+    }
+
+    static bool is_word_start(const std::string& name, size_t i)
+    {
+      auto is_alnum = [](char ch) { return std::isalnum(static_cast<unsigned char>(ch)) != 0; };
+      return i == 0 || (is_alnum(name[i]) && !is_alnum(name[i - 1]));
+    }
+
+    static void add_unique(std::vector<int>& indices, int idx)
+    {
+      if (indices.empty() || indices.back() != idx)
+        indices.emplace_back(idx);
+    }
+
+    static void insert_sorted(std::vector<int>& indices, int idx)
+    {
+      auto it = std::lower_bound(indices.begin(), indices.end(), idx);
+      if (it == indices.end() || *it != idx)
+        indices.insert(it, idx);
+    }
+
+    static void erase_sorted(std::vector<int>& indices, int idx)
+    {
+      auto it = std::lower_bound(indices.begin(), indices.end(), idx);
+      if (it != indices.end() && *it == idx)
+        indices.erase(it);
+    }
+
+    std::vector<Entry> entries;
+    std::unordered_map<char32_t, std::vector<int>> glyph_map;
+    std::unordered_map<int, std::vector<int>> mat_map;
+    std::vector<uint32_t> seen;
+    uint32_t generation = 0;
+  };
+
+}
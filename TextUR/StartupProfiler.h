@@ -0,0 +1,60 @@
+//
+//  StartupProfiler.h
+//  TextUR
+//
+
+#pragma once
+#include <chrono>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+
+
+namespace textur
+{
+
+  // Taken during static initialization, i.e. before main() is entered.
+  inline const auto process_start_time = std::chrono::steady_clock::now();
+
+  // Splits the time from process start to the first presented frame into named phases.
+  // Each call to mark() ends the current phase.
+  class StartupProfiler
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    void mark(const std::string& phase)
+    {
+      const auto now = Clock::now();
+      phases.push_back({ phase, std::chrono::duration<double, std::milli>(now - last).count() });
+      last = now;
+    }
+
+    double total_ms() const
+    {
+      return std::chrono::duration<double, std::milli>(last - process_start_time).count();
+    }
+
+    void print(std::ostream& os) const
+    {
+      os << "Startup profile:" << std::endl;
+      for (const auto& phase : phases)
+        os << "  " << std::left << std::setw(28) << phase.name
+           << std::right << std::fixed << std::setprecision(2) << std::setw(10) << phase.ms << " ms" << std::endl;
+      os << "  " << std::left << std::setw(28) << "time to first frame"
+         << std::right << std::fixed << std::setprecision(2) << std::setw(10) << total_ms() << " ms" << std::endl;
+    }
+
+  private:
+    struct Phase
+    {
+      std::string name;
+      double ms = 0.;
+    };
+
+    Clock::time_point last = process_start_time;
+    std::vector<Phase> phases;
+  };
+
+}
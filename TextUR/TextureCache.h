@@ -0,0 +1,272 @@
+//
+//  TextureCache.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+
+namespace textur
+{
+
+  inline uint64_t fnv1a(const char* data, size_t size, uint64_t h = 0xCBF29CE484222325ull)
+  {
+    for (size_t i = 0; i < size; ++i)
+    {
+      h ^= static_cast<unsigned char>(data[i]);
+      h *= 0x100000001B3ull;
+    }
+    return h;
+  }
+
+  // On-disk cache of decoded textures in a binary form that loads without any text parsing.
+  // An entry is keyed by the canonical path of the source file and is only used if the size,
+  //   modification time and content hash of the file as well as the load parameters
+  //   (ANSI default colors etc.) are the same as when the entry was written.
+  // Entries are touched on every hit and the least recently used ones are removed once
+  //   the cache grows beyond max_bytes.
+  class TextureCache
+  {
+  public:
+    void set_folder(const std::string& a_folder) { folder = a_folder; }
+    void set_max_bytes(uint64_t a_max_bytes) { max_bytes = a_max_bytes; }
+    void set_enabled(bool enable) { enabled = enable; }
+    bool is_enabled() const { return enabled; }
+
+    bool load(t8::Texture& texture, const std::string& file_path, const std::string& params)
+    {
+      Key key;
+      if (!enabled || !make_key(file_path, params, key))
+        return false;
+      const auto path_entry = entry_path(file_path);
+      std::ifstream fs(path_entry, std::ios::binary);
+      if (!fs)
+        return false;
+      char magic[sizeof(file_magic)] {};
+      Key entry_key;
+      fs.read(magic, sizeof(magic));
+      read_pod(fs, entry_key);
+      if (!fs || std::string(magic, sizeof(magic)) != std::string(file_magic, sizeof(file_magic)) || !(entry_key == key))
+        return false;
+
+      uint32_t num_colors = 0;
+      read_pod(fs, num_colors);
+      std::vector<t8::Color> palette(num_colors);
+      for (auto& color : palette)
+      {
+        uint16_t len = 0;
+        read_pod(fs, len);
+        std::string color_str(len, '\0');
+        fs.read(color_str.data(), len);
+        color.parse(color_str);
+      }
+      int32_t num_rows = 0;
+      int32_t num_cols = 0;
+      read_pod(fs, num_rows);
+      read_pod(fs, num_cols);
+      if (!fs || num_rows < 0 || num_cols < 0)
+        return false;
+      t8::Texture decoded { { num_rows, num_cols } };
+      for (int r = 0; r < num_rows; ++r)
+      {
+        for (int c = 0; c < num_cols; ++c)
+        {
+          Cell cell;
+          read_pod(fs, cell);
+          if (!fs || cell.fg >= num_colors || cell.bg >= num_colors)
+            return false;
+          t8::Textel textel;
+          textel.glyph = t8::Glyph { cell.preferred, cell.fallback };
+          textel.fg_color = palette[cell.fg];
+          textel.bg_color = palette[cell.bg];
+          textel.mat_raw = cell.mat_raw;
+          decoded.set_textel(r, c, textel);
+        }
+      }
+      texture = std::move(decoded);
+
+      std::error_code ec;
+      std::filesystem::last_write_time(path_entry, std::filesystem::file_time_type::clock::now(), ec);
+      return true;
+    }
+
+    void store(const t8::Texture& texture, const std::string& file_path, const std::string& params)
+    {
+      Key key;
+      if (!enabled || !make_key(file_path, params, key))
+        return;
+      std::error_code ec;
+      std::filesystem::create_directories(folder, ec);
+
+      std::vector<std::string> palette;
+      std::unordered_map<std::string, uint16_t> palette_lookup;
+      auto color_index = [&](const t8::Color& color)
+      {
+        auto color_str = color.str();
+        auto it = palette_lookup.find(color_str);
+        if (it != palette_lookup.end())
+          return it->second;
+        const auto idx = static_cast<uint16_t>(palette.size());
+        palette_lookup.emplace(color_str, idx);
+        palette.emplace_back(std::move(color_str));
+        return idx;
+      };
+      std::vector<Cell> cells;
+      cells.reserve(static_cast<size_t>(texture.size.r)*texture.size.c);
+      for (int r = 0; r < texture.size.r; ++r)
+        for (int c = 0; c < texture.size.c; ++c)
+        {
+          const auto& textel = texture(r, c);
+          cells.push_back({ textel.glyph.preferred, color_index(textel.fg_color), color_index(textel.bg_color),
+                            textel.glyph.fallback, textel.mat_raw });
+        }
+
+      // Written to a temporary file first so that an interrupted write never leaves a broken entry.
+      const auto path_entry = entry_path(file_path);
+      auto path_tmp = path_entry;
+      path_tmp += ".tmp";
+      {
+        std::ofstream fs(path_tmp, std::ios::binary);
+        fs.write(file_magic, sizeof(file_magic));
+        write_pod(fs, key);
+        write_pod(fs, static_cast<uint32_t>(palette.size()));
+        for (const auto& color_str : palette)
+        {
+          write_pod(fs, static_cast<uint16_t>(color_str.size()));
+          fs.write(color_str.data(), static_cast<std::streamsize>(color_str.size()));
+        }
+        write_pod(fs, static_cast<int32_t>(texture.size.r));
+        write_pod(fs, static_cast<int32_t>(texture.size.c));
+        fs.write(reinterpret_cast<const char*>(cells.data()), static_cast<std::streamsize>(cells.size()*sizeof(Cell)));
+        if (!fs)
+        {
+          fs.close();
+          std::filesystem::remove(path_tmp, ec);
+          return;
+        }
+      }
+      std::filesystem::rename(path_tmp, path_entry, ec);
+      evict();
+    }
+
+    void clear()
+    {
+      std::error_code ec;
+      for (const auto& entry : std::filesystem::directory_iterator(folder, ec))
+        if (entry.path().extension() == file_ext)
+          std::filesystem::remove(entry.path(), ec);
+    }
+
+  private:
+    static constexpr char file_magic[8] = { 'T', 'X', 'U', 'R', 'C', 'A', 'C', '1' };
+    static constexpr const char* file_ext = ".txc";
+
+    struct Key
+    {
+      uint64_t file_size = 0;
+      int64_t mtime = 0;
+      uint64_t content_hash = 0;
+      uint64_t params_hash = 0;
+
+      bool operator==(const Key& other) const
+      {
+        return file_size == other.file_size && mtime == other.mtime
+          && content_hash == other.content_hash && params_hash == other.params_hash;
+      }
+    };
+
+#pragma pack(push, 1)
+    struct Cell
+    {
+      char32_t preferred;
+      uint16_t fg;
+      uint16_t bg;
+      char fallback;
+      uint8_t mat_raw;
+    };
+#pragma pack(pop)
+
+    template<typename T>
+    static void read_pod(std::istream& is, T& val) { is.read(reinterpret_cast<char*>(&val), sizeof(T)); }
+    template<typename T>
+    static void write_pod(std::ostream& os, const T& val) { os.write(reinterpret_cast<const char*>(&val), sizeof(T)); }
+
+    std::filesystem::path entry_path(const std::string& file_path) const
+    {
+      std::error_code ec;
+      auto canonical = std::filesystem::weakly_canonical(file_path, ec).string();
+      if (ec)
+        canonical = file_path;
+      char name[17];
+      std::snprintf(name, sizeof(name), "%016llx",
+                    static_cast<unsigned long long>(fnv1a(canonical.data(), canonical.size())));
+      return std::filesystem::path(folder) / (std::string(name) + file_ext);
+    }
+
+    static bool make_key(const std::string& file_path, const std::string& params, Key& key)
+    {
+      std::error_code ec;
+      key.file_size = std::filesystem::file_size(file_path, ec);
+      if (ec)
+        return false;
+      key.mtime = static_cast<int64_t>(std::filesystem::last_write_time(file_path, ec).time_since_epoch().count());
+      if (ec)
+        return false;
+      key.params_hash = fnv1a(params.data(), params.size());
+      std::ifstream fs(file_path, std::ios::binary);
+      std::vector<char> chunk(1 << 20);
+      key.content_hash = 0xCBF29CE484222325ull;
+      while (fs)
+      {
+        fs.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        key.content_hash = fnv1a(chunk.data(), static_cast<size_t>(fs.gcount()), key.content_hash);
+      }
+      return true;
+    }
+
+    void evict()
+    {
+      struct Entry
+      {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uint64_t size = 0;
+      };
+      std::vector<Entry> entries;
+      uint64_t total_bytes = 0;
+      std::error_code ec;
+      for (const auto& entry : std::filesystem::directory_iterator(folder, ec))
+      {
+        if (entry.path().extension() != file_ext)
+          continue;
+        Entry e { entry.path(), entry.last_write_time(ec), entry.file_size(ec) };
+        total_bytes += e.size;
+        entries.emplace_back(std::move(e));
+      }
+      if (total_bytes <= max_bytes)
+        return;
+      std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+      for (const auto& e : entries)
+      {
+        if (total_bytes <= max_bytes)
+          break;
+        if (std::filesystem::remove(e.path, ec))
+          total_bytes -= e.size;
+      }
+    }
+
+    std::string folder;
+    uint64_t max_bytes = 256ull*1024*1024;
+    bool enabled = true;
+  };
+
+}
@@ -0,0 +1,135 @@
+//
+//  TextureLint.h
+//  TextUR
+//
+
+#pragma once
+#include "PresetIndex.h"
+#include <Termin8or/drawing/Texture.h>
+#include <unordered_set>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+
+namespace textur
+{
+
+  enum class LintSeverity { Error, Warning };
+
+  struct LintDiagnostic
+  {
+    int r = 0;
+    int c = 0;
+    LintSeverity severity = LintSeverity::Error;
+    std::string code;
+    std::string message;
+  };
+
+  // "<file>:<row>:<col>: <severity>: <code>: <message>", with zero based rows and columns
+  //   as in the editor.
+  inline std::string format_lint_diagnostic(const std::string& file_path, const LintDiagnostic& diag)
+  {
+    return file_path + ":" + std::to_string(diag.r) + ":" + std::to_string(diag.c) + ": "
+      + (diag.severity == LintSeverity::Error ? "error" : "warning") + ": " + diag.code + ": " + diag.message;
+  }
+
+  // Checks textures against the textel presets.
+  // The checks only read the presets and the preset index, so one linter can be
+  //   shared by any number of threads.
+  template<typename TextelItem>
+  class TextureLint
+  {
+  public:
+    TextureLint(const std::vector<TextelItem>& a_presets, const PresetIndex<TextelItem>& a_preset_index)
+      : presets(a_presets)
+      , preset_index(a_preset_index)
+    {
+      for (const auto& preset : presets)
+      {
+        any_material.emplace(without_material(preset.textel_normal));
+        any_material.emplace(without_material(preset.textel_shadow));
+      }
+    }
+
+    // Empty means any material is allowed.
+    void set_allowed_materials(const std::vector<int>& materials) { allowed_materials = materials; }
+    void set_ascii_only(bool enable) { ascii_only = enable; }
+
+    void check(const t8::Texture& texture, std::vector<LintDiagnostic>& diags) const
+    {
+      const t8::Textel empty_textel;
+      for (int r = 0; r < texture.size.r; ++r)
+      {
+        for (int c = 0; c < texture.size.c; ++c)
+        {
+          const auto& textel = texture(r, c);
+          if (textel == empty_textel)
+            continue;
+          if (preset_index.find_any(presets, textel) < 0)
+          {
+            if (any_material.count(without_material(textel)) > 0)
+              diags.push_back({ r, c, LintSeverity::Error, "preset-material",
+                                "textel matches a preset except for its material " + std::to_string(textel.decode_raw_mat()) });
+            else
+              diags.push_back({ r, c, LintSeverity::Error, "unknown-textel",
+                                "textel \"" + textel.glyph.str() + "\" is not in the textel presets" });
+          }
+          if (!allowed_materials.empty()
+              && std::find(allowed_materials.begin(), allowed_materials.end(), textel.decode_raw_mat()) == allowed_materials.end())
+            diags.push_back({ r, c, LintSeverity::Error, "unexpected-material",
+                              "material " + std::to_string(textel.decode_raw_mat()) + " is not allowed" });
+          if (ascii_only && !is_ascii(textel.glyph))
+            diags.push_back({ r, c, LintSeverity::Error, "non-ascii-glyph",
+                              "glyph \"" + textel.glyph.str() + "\" can't be saved as ASCII only" });
+        }
+      }
+    }
+
+    // The shadow texture must be what -c would produce from the normal texture.
+    void check_pair(const t8::Texture& normal, const t8::Texture& shadow, std::vector<LintDiagnostic>& diags) const
+    {
+      if (!(normal.size == shadow.size))
+      {
+        diags.push_back({ 0, 0, LintSeverity::Error, "pair-size",
+                          "size " + normal.size.str() + " differs from the dark texture size " + shadow.size.str() });
+        return;
+      }
+      for (int r = 0; r < normal.size.r; ++r)
+      {
+        for (int c = 0; c < normal.size.c; ++c)
+        {
+          const auto& textel = normal(r, c);
+          const auto preset_idx = preset_index.find_normal(presets, textel);
+          const auto& expected = 0 <= preset_idx ? presets[preset_idx].textel_shadow : textel;
+          if (!(shadow(r, c) == expected))
+            diags.push_back({ r, c, LintSeverity::Error, "pair-mismatch",
+                              0 <= preset_idx ?
+                                "dark textel is not the shadow of preset \"" + presets[preset_idx].name + "\"" :
+                                "dark textel differs from a non-preset textel" });
+        }
+      }
+    }
+
+  private:
+    static t8::Textel without_material(t8::Textel textel)
+    {
+      textel.mat_raw = t8::texture::raw_mat_none;
+      return textel;
+    }
+
+    static bool is_ascii(const t8::Glyph& glyph)
+    {
+      const bool preferred_ok = glyph.preferred == t8::Glyph::none32 || glyph.preferred < 128;
+      const bool fallback_ok = glyph.fallback == t8::Glyph::none || (32 <= glyph.fallback && glyph.fallback < 127);
+      return preferred_ok && fallback_ok;
+    }
+
+    const std::vector<TextelItem>& presets;
+    const PresetIndex<TextelItem>& preset_index;
+    std::unordered_set<t8::Textel, TextelHash> any_material;
+    std::vector<int> allowed_materials;
+    bool ascii_only = false;
+  };
+
+}
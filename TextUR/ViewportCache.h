@@ -0,0 +1,192 @@
+//
+//  ViewportCache.h
+//  TextUR
+//
+
+#pragma once
+#include <Termin8or/drawing/Texture.h>
+#include <Termin8or/geom/RC.h>
+#include <vector>
+#include <algorithm>
+
+
+namespace textur
+{
+
+  // A blank glyph (or no glyph at all) lets whatever is behind it show through
+  //   when the background is Transparent2.
+  inline bool is_blank_glyph(const t8::Glyph& glyph)
+  {
+    const bool blank_preferred = glyph.preferred == t8::Glyph::none32 || glyph.preferred == U' ';
+    const bool blank_fallback = glyph.fallback == t8::Glyph::none || glyph.fallback == ' ';
+    return blank_preferred && blank_fallback;
+  }
+
+  inline bool is_see_through(const t8::Textel& textel)
+  {
+    return textel.bg_color == t8::Color16::Transparent2 && is_blank_glyph(textel.glyph);
+  }
+
+  // Composites front over back following the same transparency rules as the screen buffer.
+  inline t8::Textel composite_textel(const t8::Textel& front, const t8::Textel& back)
+  {
+    if (is_see_through(front))
+      return back;
+    if (front.bg_color == t8::Color16::Transparent || front.bg_color == t8::Color16::Transparent2)
+    {
+      auto textel = front;
+      textel.bg_color = back.bg_color;
+      return textel;
+    }
+    return front;
+  }
+
+  // Stack is ordered front to back. Textures that don't cover (r, c) are skipped.
+  inline t8::Textel composite_stack(const std::vector<const t8::Texture*>& stack, int r, int c)
+  {
+    t8::Textel textel;
+    bool first = true;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+    {
+      const auto* tex = *it;
+      if (r >= tex->size.r || c >= tex->size.c)
+        continue;
+      textel = first ? (*tex)(r, c) : composite_textel((*tex)(r, c), textel);
+      first = false;
+    }
+    return textel;
+  }
+
+  // Size of the largest texture in the stack.
+  inline t8::RC stack_extent(const std::vector<const t8::Texture*>& stack)
+  {
+    t8::RC extent { 0, 0 };
+    for (const auto* tex : stack)
+      extent = { std::max(extent.r, tex->size.r), std::max(extent.c, tex->size.c) };
+    return extent;
+  }
+
+  // Composites the whole stack into a single texture.
+  inline t8::Texture flatten_stack(const std::vector<const t8::Texture*>& stack)
+  {
+    const auto extent = stack_extent(stack);
+    t8::Texture flat { extent };
+    for (int r = 0; r < extent.r; ++r)
+      for (int c = 0; c < extent.c; ++c)
+        flat.set_textel(r, c, composite_stack(stack, r, c));
+    return flat;
+  }
+
+  // Keeps a stack of textures composited into a single texture so that only one texture
+  //   has to be drawn per frame, no matter how many layers there are.
+  // The composite is split into square tiles that are only (re)composited when they are
+  //   both dirty and visible, so edits and scrolling only cost as much as the tiles they touch.
+  // The visible window is then copied out of the composite whenever it moves, resizes or
+  //   when one of its tiles was recomposited.
+  class ViewportCache
+  {
+  public:
+    static constexpr int tile_size = 32;
+  
+    // Marks all tiles dirty, e.g. when a layer is shown or hidden.
+    void invalidate()
+    {
+      std::fill(tile_valid.begin(), tile_valid.end(), false);
+      view_valid = false;
+    }
+
+    void mark_dirty(const t8::RC& pos)
+    {
+      const int tr = pos.r / tile_size;
+      const int tc = pos.c / tile_size;
+      if (0 <= pos.r && 0 <= pos.c && tr < num_tiles.r && tc < num_tiles.c)
+        tile_valid[tr*num_tiles.c + tc] = false;
+    }
+
+    // org and size are in texture coordinates.
+    const t8::Texture& update(const std::vector<const t8::Texture*>& stack,
+                              const t8::RC& org, const t8::RC& size)
+    {
+      fit(stack);
+    
+      const t8::RC clamped_size { std::max(0, size.r), std::max(0, size.c) };
+      if (org != view_org || clamped_size != view.size)
+      {
+        view_org = org;
+        view = t8::Texture { clamped_size };
+        view_valid = false;
+      }
+      if (clamped_size.r == 0 || clamped_size.c == 0)
+        return view;
+      
+      const int tr0 = std::max(0, view_org.r / tile_size);
+      const int tc0 = std::max(0, view_org.c / tile_size);
+      const int tr1 = std::min(num_tiles.r, (view_org.r + clamped_size.r + tile_size - 1) / tile_size);
+      const int tc1 = std::min(num_tiles.c, (view_org.c + clamped_size.c + tile_size - 1) / tile_size);
+      compose_tiles(stack, tr0, tc0, tr1, tc1);
+    
+      if (!view_valid)
+      {
+        for (int r = 0; r < view.size.r; ++r)
+          for (int c = 0; c < view.size.c; ++c)
+          {
+            const int cr = view_org.r + r;
+            const int cc = view_org.c + c;
+            if (cr < composite.size.r && cc < composite.size.c)
+              view.set_textel(r, c, composite(cr, cc));
+          }
+        view_valid = true;
+      }
+      return view;
+    }
+
+    const t8::RC& origin() const { return view_org; }
+
+  private:
+    void fit(const std::vector<const t8::Texture*>& stack)
+    {
+      t8::RC extent { 0, 0 };
+      for (const auto* tex : stack)
+        extent = { std::max(extent.r, tex->size.r), std::max(extent.c, tex->size.c) };
+      if (extent != composite.size)
+      {
+        composite = t8::Texture { extent };
+        num_tiles = { (extent.r + tile_size - 1) / tile_size, (extent.c + tile_size - 1) / tile_size };
+        tile_valid.assign(num_tiles.r*num_tiles.c, false);
+        view_valid = false;
+      }
+    }
+  
+    // Recomposites the dirty tiles in [tr0, tr1) x [tc0, tc1).
+    void compose_tiles(const std::vector<const t8::Texture*>& stack, int tr0, int tc0, int tr1, int tc1)
+    {
+      for (int tr = tr0; tr < tr1; ++tr)
+        for (int tc = tc0; tc < tc1; ++tc)
+        {
+          const int tile_idx = tr*num_tiles.c + tc;
+          if (tile_valid[tile_idx])
+            continue;
+          compose_tile(stack, tr, tc);
+          tile_valid[tile_idx] = true;
+          view_valid = false;
+        }
+    }
+  
+    void compose_tile(const std::vector<const t8::Texture*>& stack, int tr, int tc)
+    {
+      const int r1 = std::min(composite.size.r, (tr + 1)*tile_size);
+      const int c1 = std::min(composite.size.c, (tc + 1)*tile_size);
+      for (int r = tr*tile_size; r < r1; ++r)
+        for (int c = tc*tile_size; c < c1; ++c)
+          composite.set_textel(r, c, composite_stack(stack, r, c));
+    }
+
+    t8::Texture composite;
+    t8::RC num_tiles { 0, 0 };
+    std::vector<bool> tile_valid;
+    t8::Texture view;
+    t8::RC view_org { 0, 0 };
+    bool view_valid = false;
+  };
+
+}
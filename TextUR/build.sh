@@ -24,3 +24,4 @@ fi
 ### Post-Build Actions ###
 
 cp textel_presets bin/
+c++ -std=c++20 -O2 ${additional_flags} tools/live_preview_viewer.cpp -o bin/live_preview_viewer
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Fails if the time to first frame for examples/test.tx exceeds the budget.
+# Usage: ./test_startup_time.sh [budget_ms]
+# Run it from the TextUR folder after ./build.sh.
+# TextUR needs a terminal, so it is run under a pseudo-terminal when there is none (e.g. in CI).
+
+budget_ms=${1:-1000}
+cmd="bin/textur -f examples/test.tx --profile_startup --startup_budget_ms $budget_ms --suppress_tty_input"
+
+if [ ! -x bin/textur ]; then
+  echo "ERROR: bin/textur not found. Run ./build.sh first."
+  exit 1
+fi
+
+os_name=$(uname)
+
+if [ -t 0 ] && [ -t 1 ]; then
+  $cmd
+elif [[ $os_name == *"Darwin"* ]]; then
+  script -q /dev/null bash -c "stty rows 50 cols 120; $cmd" < /dev/null
+else
+  script -qec "stty rows 50 cols 120; $cmd" /dev/null < /dev/null
+fi
+
+exit_code=$?
+
+if [ $exit_code -ne 0 ]; then
+  echo "Startup time test failed with exit code $exit_code (budget $budget_ms ms)."
+  exit $exit_code
+fi
@@ -14,9 +14,38 @@
 #include <Termin8or/ui/MessageHandler.h>
 #include <Termin8or/ui/UI.h>
 #include <Core/Rand.h>
+#include "ViewportCache.h"
+#include "MaterialOccupancy.h"
+#include "BrushEngine.h"
+#include "PresetIndex.h"
+#include "PresetSearch.h"
+#include "AtlasPacker.h"
+#include "CppHeaderExport.h"
+#include "StartupProfiler.h"
+#include "MemoryTracker.h"
+#include "AnsiStreamImporter.h"
+#include "AnsiExport.h"
+#include "ContactSheet.h"
+#include "TextureLint.h"
+#include "TextureCache.h"
+#include "LatencyHistogram.h"
+#include "LivePreview.h"
+#include "PresetQuantizer.h"
+#include "DirectionalShading.h"
+#include "NoiseFill.h"
+#include "CustomPresetFile.h"
+#include "CompactRegion.h"
 
 #include <iostream>
+#include <iomanip>
 #include <stack>
+#include <deque>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 using namespace std::string_literals;
 using Color16 = t8::Color16;
@@ -52,14 +81,22 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     Textel textel_shadow;
     std::string name;
     
-    std::vector<t8::StyledString> disp_glyph_normal;
-    std::vector<t8::StyledString> disp_glyph_shadow;
+    // The display strings are built the first time they are asked for and then cached,
+    //   so presets that are never scrolled into view in the menu never pay for them.
+    t8::Style disp_style;
+    bool disp_uncanonicalize_fallback = true;
+    mutable std::vector<t8::StyledString> disp_glyph_normal;
+    mutable std::vector<t8::StyledString> disp_glyph_shadow;
+    mutable bool disp_glyph_normal_valid = false;
+    mutable bool disp_glyph_shadow_valid = false;
     
-    template<typename CharT>
-    void update_disp_strings(const t8::Style& dlg_style, bool uncanonicalize_fallback)
+    // Call whenever the textels have changed.
+    void invalidate_disp_strings(const t8::Style& dlg_style, bool uncanonicalize_fallback)
     {
-      disp_glyph_normal = format_long_glyph_disp_sstr<CharT>(textel_normal, dlg_style, uncanonicalize_fallback);
-      disp_glyph_shadow = format_long_glyph_disp_sstr<CharT>(textel_shadow, dlg_style, uncanonicalize_fallback);
+      disp_style = dlg_style;
+      disp_uncanonicalize_fallback = uncanonicalize_fallback;
+      disp_glyph_normal_valid = false;
+      disp_glyph_shadow_valid = false;
     }
     
     Textel get_textel(bool shadow) const
@@ -67,9 +104,18 @@ class Game : public t8x::GameEngine<44, 92, CharT>
       return shadow ? textel_shadow : textel_normal;
     }
     
+    template<typename CharT>
     const std::vector<t8::StyledString>& get_glyph_disp_sstr(bool shadow) const
     {
-      return shadow ? disp_glyph_shadow : disp_glyph_normal;
+      auto& disp_glyph = shadow ? disp_glyph_shadow : disp_glyph_normal;
+      auto& valid = shadow ? disp_glyph_shadow_valid : disp_glyph_normal_valid;
+      if (!valid)
+      {
+        textur::MemScope mem_scope { textur::MemTag::Presets };
+        disp_glyph = format_long_glyph_disp_sstr<CharT>(get_textel(shadow), disp_style, disp_uncanonicalize_fallback);
+        valid = true;
+      }
+      return disp_glyph;
     }
   };
   
@@ -79,6 +125,32 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     std::cout << "   -f <filepath_texture>" << std::endl;
     std::cout << "   [-s <rows> <cols>]" << std::endl;
     std::cout << "   [-t <filepath_tracing_texture>]" << std::endl;
+    std::cout << "   [-l <filepath_layer_texture>]" << std::endl;
+    std::cout << "   [--export_flattened <filepath_flattened_texture>]" << std::endl;
+    std::cout << "   [--pack_atlas <dir_sprite_textures> <filepath_atlas_texture>]" << std::endl;
+    std::cout << "   [--set_atlas_padding <ap>]" << std::endl;
+    std::cout << "   [--contact_sheet <dir_textures> <filepath_contact_sheet>]" << std::endl;
+    std::cout << "   [--set_thumbnail_size <thumb_rows> <thumb_cols>]" << std::endl;
+    std::cout << "   [--lint <path_lint>]" << std::endl;
+    std::cout << "   [--lint_materials <lint_mats>]" << std::endl;
+    std::cout << "   [--lint_shadow_suffix <lint_suffix>]" << std::endl;
+    std::cout << "   [--export_cpp_header <filepath_cpp_header>]" << std::endl;
+    std::cout << "   [--export_cpp_header_shadow]" << std::endl;
+    std::cout << "   [--export_ansi <filepath_ansi_export>]" << std::endl;
+    std::cout << "   [--export_shading <filepath_shading_base> <sun_directions>]" << std::endl;
+    std::cout << "   [--set_shading_heights <shading_heights>]" << std::endl;
+    std::cout << "   [--profile_startup]" << std::endl;
+    std::cout << "   [--startup_budget_ms <sb>]" << std::endl;
+    std::cout << "   [--mem_report]" << std::endl;
+    std::cout << "   [--latency_report]" << std::endl;
+    std::cout << "   [--live_preview <socket_path>]" << std::endl;
+    std::cout << "   [--stream_ansi]" << std::endl;
+    std::cout << "   [--import_ansi <filepath_ansi> <filepath_imported_texture>]" << std::endl;
+    std::cout << "   [--set_ansi_wrap_width <aww>]" << std::endl;
+    std::cout << "   [--quantize_ansi]" << std::endl;
+    std::cout << "   [--no_texture_cache]" << std::endl;
+    std::cout << "   [--clear_texture_cache]" << std::endl;
+    std::cout << "   [--set_texture_cache_size_mb <tcs>]" << std::endl;
     std::cout << "   [-c <filepath_dark_texture>]" << std::endl;
     std::cout << "   [-o <filepath_saved_texture>]" << std::endl;
     std::cout << "   [--log_mode (record | replay)]" << std::endl;
@@ -92,7 +164,15 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     std::cout << "   [--set_ansi_default_bg <color>]" << std::endl;
     std::cout << "   [--set_big_brush_aspect_ratio <bar>]" << std::endl;
     std::cout << "   [--set_big_brush_radius <br>]" << std::endl;
+    std::cout << "   [--set_big_brush_shape <bs>]" << std::endl;
+    std::cout << "   [--set_big_brush_stamp <filepath_stamp_texture>]" << std::endl;
+    std::cout << "   [--set_random_brush_density <rbd>]" << std::endl;
+    std::cout << "   [--set_random_brush_falloff <rbf>]" << std::endl;
+    std::cout << "   [--seed <seed>]" << std::endl;
+    std::cout << "   [--set_noise_fill_scale <nfs>]" << std::endl;
+    std::cout << "   [--set_noise_fill_octaves <nfo>]" << std::endl;
     std::cout << "   [--set_adhoc_textel_material <mat>]" << std::endl;
+    std::cout << "   [--set_max_used_textels <mut>]" << std::endl;
     std::cout << std::endl;
     std::cout << "  -f                         : Specifies the source file to (create and) edit." << std::endl;
     std::cout << "  <filepath_texture>         : Filepath for texture to edit. If file does not yet exist," << std:: endl;
@@ -101,6 +181,63 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     std::cout << "                             : If <filepath_texture> already exists, then it will be overwritten." << std::endl;
     std::cout << "  -t                         : Specifies a tracing texture." << std::endl;
     std::cout << "  <filepath_tracing_texture> : Filepath to tracing texture. Helps when making animations." << std::endl;
+    std::cout << "  -l                         : Adds a layer on top of <filepath_texture> (and previous layers)." << std::endl;
+    std::cout << "                               Can be given multiple times. Select layers with keys 1 - 9." << std::endl;
+    std::cout << "  <filepath_layer_texture>   : Filepath to layer texture. If the file does not yet exist, then" << std::endl;
+    std::cout << "                               an empty layer of the same size as <filepath_texture> is created." << std::endl;
+    std::cout << "  --export_flattened         : Also export the visible layers flattened into a single texture." << std::endl;
+    std::cout << "  <filepath_flattened_texture> : Filepath for the flattened texture." << std::endl;
+    std::cout << "  --pack_atlas               : Packs all .tx and .ans files in <dir_sprite_textures> into a single" << std::endl;
+    std::cout << "                               atlas texture and writes an index file <filepath_atlas_texture>.idx" << std::endl;
+    std::cout << "                               with one \"<name> <row> <col> <rows> <cols>\" line per sprite." << std::endl;
+    std::cout << "                               The program exits when packing is completed." << std::endl;
+    std::cout << "  <ap>                       : Number of empty cells between sprites in the atlas. Default value = 0." << std::endl;
+    std::cout << "  --contact_sheet            : Loads all .tx and .ans files in <dir_textures> in parallel, shrinks" << std::endl;
+    std::cout << "                               them to thumbnails and writes them side by side to a single .tx or" << std::endl;
+    std::cout << "                               .ans file together with a manifest <filepath_contact_sheet>.idx." << std::endl;
+    std::cout << "                               The program exits when the contact sheet is completed." << std::endl;
+    std::cout << "  <thumb_rows> <thumb_cols>  : Max thumbnail size for --contact_sheet. Default value = 10 x 20." << std::endl;
+    std::cout << "  --lint                     : Checks all .tx and .ans files in <path_lint> (a file or a folder that" << std::endl;
+    std::cout << "                               is searched recursively) against the textel presets in parallel and" << std::endl;
+    std::cout << "                               prints one \"<file>:<row>:<col>: error: <code>: <message>\" line per" << std::endl;
+    std::cout << "                               problem. Can be given multiple times. Together with" << std::endl;
+    std::cout << "                               --save_textures_as_ascii_only, non-ASCII glyphs are reported too." << std::endl;
+    std::cout << "                               The program exits with a failure code if any errors were found." << std::endl;
+    std::cout << "  <lint_mats>                : Comma separated list of allowed materials, e.g. \"0,1,5\"." << std::endl;
+    std::cout << "  <lint_suffix>              : Filename suffix of dark textures, e.g. \"_dark\" pairs foo.tx with" << std::endl;
+    std::cout << "                               foo_dark.tx, which must then be what -c produces from foo.tx." << std::endl;
+    std::cout << "  --export_cpp_header        : Exports <filepath_texture> (and its layers) as constexpr arrays in a" << std::endl;
+    std::cout << "                               C++ header. The program exits when the export is completed." << std::endl;
+    std::cout << "  --export_cpp_header_shadow : Also export the dark mode variants (see -c) to the C++ header." << std::endl;
+    std::cout << "  --export_ansi              : Exports the visible layers flattened as ANSI art with minimal escape" << std::endl;
+    std::cout << "                               sequences. The program exits when the export is completed." << std::endl;
+    std::cout << "  --export_shading           : Exports the visible layers flattened and shaded for each sun direction in" << std::endl;
+    std::cout << "                               <sun_directions> (comma separated list of zenith, n, ne, e, se, s, sw, w" << std::endl;
+    std::cout << "                               and nw, or all) to <filepath_shading_base> with _<dir> appended to the" << std::endl;
+    std::cout << "                               file name. The program exits when the export is completed." << std::endl;
+    std::cout << "  <shading_heights>          : Comma separated <mat>:<height> pairs. Cells next to taller materials" << std::endl;
+    std::cout << "                               are shaded (get the shadow textel of their preset) on the side facing" << std::endl;
+    std::cout << "                               away from the sun. Used by --export_shading and the Y key." << std::endl;
+    std::cout << "  --profile_startup          : Quits after the first frame and prints how long each startup phase took." << std::endl;
+    std::cout << "  <sb>                       : Time to first frame budget in milliseconds for --profile_startup." << std::endl;
+    std::cout << "                               The program exits with a failure code if the budget is exceeded." << std::endl;
+    std::cout << "  --mem_report               : Prints the memory held by textures, undo/redo, presets etc. at exit." << std::endl;
+    std::cout << "  --latency_report           : Prints a histogram of the keypress to screen update latencies at exit." << std::endl;
+    std::cout << "  --live_preview             : Publishes the edits of each frame to viewers connected to the Unix domain" << std::endl;
+    std::cout << "                               socket <socket_path>, e.g. a game running with the texture loaded." << std::endl;
+    std::cout << "                               Not available on Windows." << std::endl;
+    std::cout << "  --stream_ansi              : Loads .ans, .asc and .nfo files given with -f, -l and -t in chunks" << std::endl;
+    std::cout << "                               instead of reading the whole file into memory first." << std::endl;
+    std::cout << "  --import_ansi              : Streams <filepath_ansi> into <filepath_imported_texture>, prints the" << std::endl;
+    std::cout << "                               throughput and exits." << std::endl;
+    std::cout << "  <aww>                      : Column at which streamed ANSI art wraps. 0 = no wrapping. Default value = 80." << std::endl;
+    std::cout << "  --quantize_ansi            : Replaces each textel of ANSI art given with -f, -l, --import_ansi or as the" << std::endl;
+    std::cout << "                               source of -c with the nearest textel preset by glyph and color, so that" << std::endl;
+    std::cout << "                               the cells get the materials and shadows of the presets." << std::endl;
+    std::cout << "  --no_texture_cache         : Always parse the texture files given with -f, -l and -t instead of" << std::endl;
+    std::cout << "                               using the decoded copies in the texture_cache folder." << std::endl;
+    std::cout << "  --clear_texture_cache      : Removes all decoded copies from the texture_cache folder." << std::endl;
+    std::cout << "  <tcs>                      : Max size of the texture_cache folder in MiB. Default value = 256." << std::endl;
     std::cout << "  -c                         : Specifies a file to convert the current light mode texture" << std::endl;
     std::cout << "                               <filepath_texture> to a dark mode texture." << std::endl;
     std::cout << "  -o                         : Specifies the filepath for saved texture." << std::endl;
@@ -115,82 +252,541 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     std::cout << "  <filepath_dark_texture>    : The destination filepath to the generated dark mode texture." << std::endl;
     std::cout << "  <bar>                      : Aspect ratio for big brushes. Default value = 1.84." << std::endl;
     std::cout << "  <br>                       : Radius for big brushes. Default value = 10.5." << std::endl;
+    std::cout << "  <bs>                       : Shape for big brushes: circle, square or diamond. Default value = circle." << std::endl;
+    std::cout << "  <filepath_stamp_texture>   : Texture whose non-transparent cells form a custom big brush stamp." << std::endl;
+    std::cout << "  <rbd>                      : Density scale for randomized brushes. Default value = 1." << std::endl;
+    std::cout << "  <rbf>                      : Falloff for randomized brushes. Larger values spread textels further" << std::endl;
+    std::cout << "                               from the center. Default value = 0.1." << std::endl;
+    std::cout << "  <seed>                     : Seed for randomized brushes and the noise fill. Use the same seed to" << std::endl;
+    std::cout << "                               reproduce strokes, e.g. when replaying a log. Default is a random seed." << std::endl;
+    std::cout << "  <nfs>                      : Size in cells of the largest features of the noise fill. Default value = 8." << std::endl;
+    std::cout << "  <nfo>                      : Number of octaves (finer and finer detail) of the noise fill. Default value = 4." << std::endl;
     std::cout << "  <mat>                      : AdHoc Textel material. Default value = -1." << std::endl;
+    std::cout << "  <mut>                      : Max number of recently used textels. Default value = 20." << std::endl;
     std::cout << std::endl;
     std::cout << "  Press 'K' in editor for list of supported key presses." << std::endl;
     exit(EXIT_SUCCESS);
   }
 
-  void draw_menu(const t8::Style& ui_style, const int menu_width)
+  void pack_atlas_and_exit() const
   {
-    const int nri = sh.num_rows_inset();
-    const int nc = sh.num_cols();
-
-    const bool draw_used_textels = show_menu_used_textels;
-    int& menu_offset = draw_used_textels ? menu_r_offs_ut : menu_r_offs;
-    const int selected_idx = draw_used_textels ? selected_used_textel_idx : selected_textel_preset_idx;
-    const int num_items = draw_used_textels
-      ? static_cast<int>(used_textels.size())
-      : static_cast<int>(textel_presets.size());
-    const int row_step = draw_used_textels ? 1 : 3;
-    const int box_height = row_step + 1;
-
-    int r = menu_offset;
-    for (int idx = 0; idx < num_items; ++idx)
+    namespace fs = std::filesystem;
+    std::vector<fs::path> sprite_paths;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir_atlas_sprites, ec))
     {
-      const bool selected = idx == selected_idx;
-      if (selected)
+      const auto ext = entry.path().extension().string();
+      if (entry.is_regular_file() && (ext == ".tx" || ext == ".ans"))
+        sprite_paths.emplace_back(entry.path());
+    }
+    if (ec)
+    {
+      std::cerr << "ERROR: Unable to read sprite folder \"" << dir_atlas_sprites << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::sort(sprite_paths.begin(), sprite_paths.end());
+    
+    std::vector<Texture> sprites(sprite_paths.size());
+    std::vector<RC> sizes(sprite_paths.size());
+    for (size_t idx = 0; idx < sprite_paths.size(); ++idx)
+    {
+      if (!t8::TextureFile::load(sprites[idx], sprite_paths[idx].string(),
+                                 t8::TextureFileFormat::Auto,
+                                 true,
+                                 t8::AnsiLoadGlyphEncoding::Auto,
+                                 ansi_default_fg,
+                                 ansi_default_bg))
       {
-        if (r + row_step - 1 >= nri)
-          menu_offset -= row_step;
-        else if (r < 0)
-          menu_offset += row_step;
+        std::cerr << "ERROR: Unable to parse sprite texture file \"" << sprite_paths[idx].string() << "\"." << std::endl;
+        exit(EXIT_FAILURE);
       }
+      sizes[idx] = sprites[idx].size;
+    }
+    
+    RC atlas_size;
+    const auto positions = textur::pack_atlas(sizes, atlas_padding, atlas_size);
+    Texture atlas { atlas_size };
+    for (size_t idx = 0; idx < sprites.size(); ++idx)
+      for (int r = 0; r < sizes[idx].r; ++r)
+        for (int c = 0; c < sizes[idx].c; ++c)
+          atlas.set_textel(positions[idx].r + r, positions[idx].c + c, sprites[idx](r, c));
+    
+    if (!save_texture(atlas, file_path_atlas_texture))
+    {
+      std::cerr << "ERROR: Unable to save atlas texture file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::ofstream fs_idx(file_path_atlas_texture + ".idx");
+    fs_idx << "# <name> <row> <col> <rows> <cols>\n";
+    for (size_t idx = 0; idx < sprites.size(); ++idx)
+      fs_idx << sprite_paths[idx].stem().string() << " "
+             << positions[idx].r << " " << positions[idx].c << " "
+             << sizes[idx].r << " " << sizes[idx].c << "\n";
+    if (!fs_idx)
+    {
+      std::cerr << "ERROR: Unable to write atlas index file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::cout << "Packed " << sprites.size() << " sprites into a " << atlas_size.r << " x " << atlas_size.c
+              << " atlas." << std::endl;
+    exit(EXIT_SUCCESS);
+  }
 
-      if (draw_used_textels)
+  static bool is_ansi_file(const std::string& file_path)
+  {
+    const auto ext = str::to_lower(std::filesystem::path(file_path).extension().string());
+    return ext == ".ans" || ext == ".asc" || ext == ".nfo";
+  }
+  
+  // Goes through the streaming importer for ANSI art if --stream_ansi is given.
+  // Safe to call from several threads at once when stream_stats is nullptr.
+  bool load_texture(Texture& texture, const std::string& file_path,
+                    textur::AnsiStreamStats* stream_stats = nullptr) const
+  {
+    if (stream_ansi && is_ansi_file(file_path))
+    {
+      textur::AnsiStreamImporter importer { ansi_default_fg, ansi_default_bg, ansi_wrap_width };
+      if (!importer.load(texture, file_path))
+        return false;
+      if (stream_stats != nullptr)
       {
-        const auto& textel = used_textels[idx];
-        sh.write_buffer(selected ? '>' : ' ', r + 1, nc - menu_width + 1,
-                        selected ? Color16::Cyan : Color16::LightGray, Color16::Black);
-        sh.write_buffer(textel.glyph, r + 1, nc - menu_width + 2,
-                        textel.fg_color, textel.bg_color);
+        stream_stats->num_bytes += importer.get_stats().num_bytes;
+        stream_stats->seconds += importer.get_stats().seconds;
       }
+      return true;
+    }
+    return t8::TextureFile::load(texture, file_path,
+                                 t8::TextureFileFormat::Auto,
+                                 true,
+                                 t8::AnsiLoadGlyphEncoding::Auto,
+                                 ansi_default_fg,
+                                 ansi_default_bg);
+  }
+  
+  // Each worker only holds the texture it is currently shrinking, so memory stays
+  //   bounded by the sheet itself no matter how many textures there are.
+  void make_contact_sheet_and_exit() const
+  {
+    namespace fs = std::filesystem;
+    std::vector<fs::path> texture_paths;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir_contact_sheet_textures, ec))
+    {
+      const auto ext = entry.path().extension().string();
+      if (entry.is_regular_file() && (ext == ".tx" || ext == ".ans"))
+        texture_paths.emplace_back(entry.path());
+    }
+    if (ec)
+    {
+      std::cerr << "ERROR: Unable to read texture folder \"" << dir_contact_sheet_textures << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::sort(texture_paths.begin(), texture_paths.end());
+    
+    const int num_textures = static_cast<int>(texture_paths.size());
+    const textur::ContactSheetLayout layout { num_textures, thumbnail_size, 1 };
+    Texture sheet { layout.get_sheet_size() };
+    std::vector<RC> orig_sizes(num_textures);
+    std::vector<RC> thumb_sizes(num_textures);
+    std::vector<char> loaded(num_textures, 0);
+    
+    std::mutex sheet_mutex;
+    std::atomic<int> next_idx { 0 };
+    auto worker = [&]()
+    {
+      for (int idx = next_idx++; idx < num_textures; idx = next_idx++)
+      {
+        Texture texture;
+        if (!load_texture(texture, texture_paths[idx].string()))
+          continue;
+        const auto thumbnail = textur::make_thumbnail(texture, thumbnail_size);
+        const auto pos = layout.get_slot_pos(idx);
+        std::scoped_lock lock { sheet_mutex };
+        for (int r = 0; r < thumbnail.size.r; ++r)
+          for (int c = 0; c < thumbnail.size.c; ++c)
+            sheet.set_textel(pos.r + r, pos.c + c, thumbnail(r, c));
+        orig_sizes[idx] = texture.size;
+        thumb_sizes[idx] = thumbnail.size;
+        loaded[idx] = 1;
+      }
+    };
+    const int num_threads = std::max(1, std::min(num_textures, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+      threads.emplace_back(worker);
+    for (auto& thread : threads)
+      thread.join();
+    
+    const bool saved = str::to_lower(fs::path(file_path_contact_sheet).extension().string()) == ".ans" ?
+      textur::AnsiExport { ansi_default_fg, ansi_default_bg, save_textures_as_ascii_only }.write(file_path_contact_sheet, sheet) :
+      save_texture(sheet, file_path_contact_sheet);
+    if (!saved)
+    {
+      std::cerr << "ERROR: Unable to save contact sheet file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::ofstream fs_idx(file_path_contact_sheet + ".idx");
+    fs_idx << "# <name> <row> <col> <thumb_rows> <thumb_cols> <rows> <cols>\n";
+    int num_failed = 0;
+    for (int idx = 0; idx < num_textures; ++idx)
+    {
+      if (!loaded[idx])
+      {
+        std::cerr << "WARNING: Unable to parse texture file \"" << texture_paths[idx].string() << "\"." << std::endl;
+        num_failed++;
+        continue;
+      }
+      const auto pos = layout.get_slot_pos(idx);
+      fs_idx << texture_paths[idx].stem().string() << " " << pos.r << " " << pos.c << " "
+             << thumb_sizes[idx].r << " " << thumb_sizes[idx].c << " "
+             << orig_sizes[idx].r << " " << orig_sizes[idx].c << "\n";
+    }
+    if (!fs_idx)
+    {
+      std::cerr << "ERROR: Unable to write contact sheet manifest file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::cout << "Wrote " << num_textures - num_failed << " thumbnails to a " << sheet.size.r << " x " << sheet.size.c
+              << " contact sheet using " << num_threads << " threads." << std::endl;
+    exit(num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  
+  void lint_and_exit()
+  {
+    namespace fs = std::filesystem;
+    const auto t0 = std::chrono::steady_clock::now();
+    
+    reload_textel_presets();
+    
+    auto is_texture_file = [](const fs::path& path)
+    {
+      const auto ext = path.extension().string();
+      return ext == ".tx" || ext == ".ans";
+    };
+    std::vector<fs::path> texture_paths;
+    for (const auto& lint_path : lint_paths)
+    {
+      std::error_code ec;
+      if (fs::is_regular_file(lint_path, ec))
+        texture_paths.emplace_back(lint_path);
       else
+        for (const auto& entry : fs::recursive_directory_iterator(lint_path, ec))
+          if (entry.is_regular_file() && is_texture_file(entry.path()))
+            texture_paths.emplace_back(entry.path());
+      if (ec)
       {
-        const auto& preset = textel_presets[idx];
-        auto disp_glyph = preset.get_glyph_disp_sstr(use_shadow_textels);
-        const auto fg_color_bracket = selected ? Color16::LightGray : Color16::DarkGray;
-        const auto num_disp_glyphs = disp_glyph.size();
-        if (num_disp_glyphs == 5)
+        std::cerr << "ERROR: Unable to read lint path \"" << lint_path << "\"." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    std::sort(texture_paths.begin(), texture_paths.end());
+    texture_paths.erase(std::unique(texture_paths.begin(), texture_paths.end()), texture_paths.end());
+    
+    textur::TextureLint<TextelItem> lint { textel_presets, preset_index };
+    lint.set_allowed_materials(lint_materials);
+    lint.set_ascii_only(save_textures_as_ascii_only);
+    
+    // The dark texture of foo.tx is foo<suffix>.tx.
+    auto shadow_path = [this](const fs::path& path)
+    {
+      if (lint_shadow_suffix.empty())
+        return fs::path {};
+      const auto stem = path.stem().string();
+      if (stem.size() >= lint_shadow_suffix.size()
+          && stem.compare(stem.size() - lint_shadow_suffix.size(), lint_shadow_suffix.size(), lint_shadow_suffix) == 0)
+        return fs::path {};
+      return path.parent_path() / (stem + lint_shadow_suffix + path.extension().string());
+    };
+    
+    const int num_files = static_cast<int>(texture_paths.size());
+    std::vector<std::vector<textur::LintDiagnostic>> diags(num_files);
+    std::atomic<int> next_idx { 0 };
+    auto worker = [&]()
+    {
+      for (int idx = next_idx++; idx < num_files; idx = next_idx++)
+      {
+        Texture texture;
+        if (!load_texture(texture, texture_paths[idx].string()))
         {
-          disp_glyph[0].style.fg_color = fg_color_bracket;
-          disp_glyph[2].style.fg_color = fg_color_bracket;
-          disp_glyph[4].style.fg_color = fg_color_bracket;
+          diags[idx].push_back({ 0, 0, textur::LintSeverity::Error, "parse", "unable to parse texture file" });
+          continue;
         }
-        else if (num_disp_glyphs == 4)
+        lint.check(texture, diags[idx]);
+        const auto path_shadow = shadow_path(texture_paths[idx]);
+        std::error_code ec;
+        if (!path_shadow.empty() && fs::exists(path_shadow, ec))
         {
-          disp_glyph[0].style.fg_color = fg_color_bracket;
-          disp_glyph[2].style.fg_color = fg_color_bracket;
-          disp_glyph[3].style.fg_color = fg_color_bracket;
+          Texture texture_shadow;
+          if (load_texture(texture_shadow, path_shadow.string()))
+            lint.check_pair(texture, texture_shadow, diags[idx]);
+          else
+            diags[idx].push_back({ 0, 0, textur::LintSeverity::Error, "parse", "unable to parse dark texture file" });
         }
-        sh.write_buffer(disp_glyph, r + 1, nc - menu_width + 2);
+      }
+    };
+    const int num_threads = std::max(1, std::min(num_files, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+      threads.emplace_back(worker);
+    for (auto& thread : threads)
+      thread.join();
+    
+    int num_errors = 0;
+    int num_warnings = 0;
+    for (int idx = 0; idx < num_files; ++idx)
+    {
+      const auto file_path = texture_paths[idx].string();
+      for (const auto& diag : diags[idx])
+      {
+        std::cout << textur::format_lint_diagnostic(file_path, diag) << "\n";
+        (diag.severity == textur::LintSeverity::Error ? num_errors : num_warnings)++;
+      }
+    }
+    std::cout << std::flush;
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cerr << "Linted " << num_files << " files in " << std::fixed << std::setprecision(2) << seconds << " s: "
+              << num_errors << " errors, " << num_warnings << " warnings." << std::endl;
+    exit(num_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  
+  // Everything besides the file contents that affects how a texture file is decoded.
+  std::string texture_cache_params() const
+  {
+    return ansi_default_fg.str() + ";" + ansi_default_bg.str() + ";"
+      + std::to_string(stream_ansi) + ";" + std::to_string(ansi_wrap_width);
+  }
+  
+  // Called once the textel presets are loaded. Quantizing after the texture cache means that
+  //   cached entries stay valid when the presets change.
+  void quantize_ansi_textures()
+  {
+    if (!quantize_ansi)
+      return;
+    textur::PresetQuantizer<TextelItem> quantizer { textel_presets, ansi_default_fg, ansi_default_bg };
+    if (convert)
+    {
+      if (is_ansi_file(file_path_bright_texture))
+        quantizer.quantize(bright_texture);
+    }
+    else
+    {
+      if (is_ansi_file(file_path_curr_texture))
+        quantizer.quantize(curr_texture);
+      for (size_t layer_idx = 1; layer_idx < layers.size(); ++layer_idx)
+        if (is_ansi_file(layers[layer_idx].file_path))
+          quantizer.quantize(layers[layer_idx].texture);
+    }
+    quantize_stats = quantizer.get_stats();
+  }
+  
+  // A hit in the texture cache skips the text parsing altogether.
+  bool load_texture_cached(Texture& texture, const std::string& file_path)
+  {
+    const auto params = texture_cache_params();
+    if (texture_cache.load(texture, file_path, params))
+      return true;
+    if (!load_texture(texture, file_path, &ansi_stream_stats))
+      return false;
+    texture_cache.store(texture, file_path, params);
+    return true;
+  }
+  
+  void import_ansi_and_exit()
+  {
+    textur::AnsiStreamImporter importer { ansi_default_fg, ansi_default_bg, ansi_wrap_width };
+    Texture texture;
+    if (!importer.load(texture, file_path_import_ansi))
+    {
+      std::cerr << "ERROR: Unable to read ANSI file \"" << file_path_import_ansi << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (quantize_ansi)
+    {
+      reload_textel_presets();
+      textur::PresetQuantizer<TextelItem> quantizer { textel_presets, ansi_default_fg, ansi_default_bg };
+      quantizer.quantize(texture);
+      quantize_stats = quantizer.get_stats();
+    }
+    if (!save_texture(texture, file_path_imported_texture))
+    {
+      std::cerr << "ERROR: Unable to save imported texture file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const auto& stats = importer.get_stats();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Imported a " << texture.size.r << " x " << texture.size.c << " texture ("
+              << (stats.encoding == textur::AnsiStreamEncoding::Cp437 ? "CP437" : "UTF-8") << ") from "
+              << stats.num_bytes/1e6 << " MB in " << stats.seconds << " s ("
+              << stats.mb_per_s() << " MB/s)." << std::endl;
+    if (quantize_ansi)
+      std::cout << "Quantized " << quantize_stats.num_cells << " cells (" << quantize_stats.num_unique
+                << " distinct textels) to textel presets in " << quantize_stats.seconds << " s." << std::endl;
+    exit(EXIT_SUCCESS);
+  }
 
-        auto name_style = ui_style;
+  void draw_menu(const t8::Style& ui_style, const int menu_width)
+  {
+    const int nri = sh.num_rows_inset();
+    const int nc = sh.num_cols();
+
+    if (show_menu_used_textels)
+    {
+      int r = menu_r_offs_ut;
+      int idx = 0;
+      for (const auto& textel : used_textels)
+      {
+        const bool selected = idx == selected_used_textel_idx;
         if (selected)
-          name_style.fg_color = Color16::Cyan;
-        sh.write_buffer(preset.name, r + 2, nc - menu_width + 2, name_style);
+        {
+          if (r >= nri)
+            menu_r_offs_ut -= 1;
+          else if (r < 0)
+            menu_r_offs_ut += 1;
+        }
+        sh.write_buffer(selected ? '>' : ' ', r + 1, nc - menu_width + 1,
+                        selected ? Color16::Cyan : Color16::LightGray, Color16::Black);
+        sh.write_buffer(textel.glyph, r + 1, nc - menu_width + 2,
+                        textel.fg_color, textel.bg_color);
+        r++;
+        idx++;
       }
+      return;
+    }
+
+    const int row_step = 3;
+    const int box_height = row_step + 1;
+    
+    if (menu_search_typing || menu_filtered())
+    {
+      auto search_str = "/" + menu_search_query + (menu_search_typing ? "_" : "");
+      const int max_len = menu_width - 2;
+      if (str::lenI(search_str) > max_len)
+        search_str = search_str.substr(search_str.size() - max_len);
+      sh.write_buffer(search_str, sh.num_rows() - 1, nc - menu_width + 1, Color16::Yellow, Color16::Black);
+      if (menu_search_result.empty() && menu_filtered())
+        sh.write_buffer("No matches", 1, nc - menu_width + 2, ui_style);
+    }
+    
+    const int selected_slot = menu_slot_of(selected_textel_preset_idx);
+    const int selected_r = menu_r_offs + row_step*selected_slot;
+    if (selected_r + row_step - 1 >= nri)
+      menu_r_offs -= row_step;
+    else if (selected_r < 0)
+      menu_r_offs += row_step;
 
-      if (!draw_used_textels)
+    // Only the slots that are on screen are visited.
+    const int num_slots = menu_num_slots();
+    const int slot_begin = std::max(0, -menu_r_offs/row_step - 1);
+    const int slot_end = std::min(num_slots, slot_begin + nri/row_step + 2);
+    for (int slot_idx = slot_begin; slot_idx < slot_end; ++slot_idx)
+    {
+      const int r = menu_r_offs + row_step*slot_idx;
+      const auto slot = menu_slot(slot_idx);
+      const bool selected = slot.group < 0 && slot.preset_idx == selected_textel_preset_idx;
+      const auto& preset = textel_presets[slot.preset_idx];
+      auto disp_glyph = preset.get_glyph_disp_sstr<CharT>(use_shadow_textels);
+      const auto fg_color_bracket = selected ? Color16::LightGray : Color16::DarkGray;
+      const auto num_disp_glyphs = disp_glyph.size();
+      if (num_disp_glyphs == 5)
       {
-        // Does not need to be qualified with t8x::, but I'm not sure why.
-        t8x::draw_box_outline(sh, r, nc - menu_width, box_height, menu_width,
-                              t8x::OutlineType::Unicode_SingleLine, ui_style);
+        disp_glyph[0].style.fg_color = fg_color_bracket;
+        disp_glyph[2].style.fg_color = fg_color_bracket;
+        disp_glyph[4].style.fg_color = fg_color_bracket;
       }
-      r += row_step;
+      else if (num_disp_glyphs == 4)
+      {
+        disp_glyph[0].style.fg_color = fg_color_bracket;
+        disp_glyph[2].style.fg_color = fg_color_bracket;
+        disp_glyph[3].style.fg_color = fg_color_bracket;
+      }
+      sh.write_buffer(disp_glyph, r + 1, nc - menu_width + 2);
+
+      auto name_style = ui_style;
+      if (selected)
+        name_style.fg_color = Color16::Cyan;
+      if (slot.group >= 0)
+      {
+        name_style.fg_color = Color16::DarkGray;
+        auto group_name = "+Mat " + std::to_string(material_groups.group_material(slot.group))
+          + " (" + std::to_string(material_groups.group_size(slot.group)) + ")";
+        sh.write_buffer(group_name.substr(0, menu_width - 2), r + 2, nc - menu_width + 2, name_style);
+      }
+      else
+        sh.write_buffer(preset.name, r + 2, nc - menu_width + 2, name_style);
+
+      // Does not need to be qualified with t8x::, but I'm not sure why.
+      t8x::draw_box_outline(sh, r, nc - menu_width, box_height, menu_width,
+                            t8x::OutlineType::Unicode_SingleLine, ui_style);
     }
   }
   
+  // A slot is a box in the textel preset menu. In the material grouped view, every group
+  //   except the one containing the selected preset is collapsed into a single slot.
+  struct MenuSlot
+  {
+    int preset_idx = 0;
+    int group = -1; // >= 0 : collapsed group.
+  };
+  
+  int menu_num_slots() const
+  {
+    if (menu_filtered())
+      return static_cast<int>(menu_search_result.size());
+    if (!menu_group_by_material)
+      return static_cast<int>(textel_presets.size());
+    const int sel_group = material_groups.group(selected_textel_preset_idx);
+    return material_groups.num_groups() + material_groups.group_size(sel_group) - 1;
+  }
+  
+  MenuSlot menu_slot(int slot_idx) const
+  {
+    if (menu_filtered())
+      return { menu_search_result[slot_idx], -1 };
+    if (!menu_group_by_material)
+      return { slot_idx, -1 };
+    const int sel_group = material_groups.group(selected_textel_preset_idx);
+    const int sel_group_size = material_groups.group_size(sel_group);
+    if (slot_idx < sel_group)
+      return { material_groups.group_start(slot_idx), slot_idx };
+    if (slot_idx < sel_group + sel_group_size)
+      return { material_groups.group_start(sel_group) + slot_idx - sel_group, -1 };
+    const int g = slot_idx - sel_group_size + 1;
+    return { material_groups.group_start(g), g };
+  }
+  
+  int menu_slot_of(int preset_idx) const
+  {
+    if (menu_filtered())
+    {
+      auto it = std::lower_bound(menu_search_result.begin(), menu_search_result.end(), preset_idx);
+      return static_cast<int>(it - menu_search_result.begin());
+    }
+    if (!menu_group_by_material)
+      return preset_idx;
+    const int g = material_groups.group(preset_idx);
+    return g + preset_idx - material_groups.group_start(g);
+  }
+  
+  // The menu only lists the search results while a search query is active.
+  bool menu_filtered() const { return !menu_search_query.empty(); }
+  
+  void update_menu_search()
+  {
+    preset_search.find(menu_search_query, menu_search_result);
+    if (!menu_search_result.empty()
+        && !std::binary_search(menu_search_result.begin(), menu_search_result.end(), selected_textel_preset_idx))
+      selected_textel_preset_idx = menu_search_result.front();
+    menu_r_offs = -3*menu_slot_of(selected_textel_preset_idx);
+  }
+  
+  void clear_menu_search()
+  {
+    menu_search_typing = false;
+    menu_search_query.clear();
+    menu_search_result.clear();
+    menu_r_offs = -3*menu_slot_of(selected_textel_preset_idx);
+  }
+  
   void draw_coord_sys(bool draw_v_coords, bool draw_h_coords,
                       bool draw_v_cursor_line, bool draw_h_cursor_line,
                       int nc, int menu_width)
@@ -239,6 +835,8 @@ class Game : public t8x::GameEngine<44, 92, CharT>
       "Esc : close windows.",
       "WASD or arrow keys : cursor navigation or textel preset selection (menu).",
       "  In textel menu, a or left / d or right scrolls from material to material.",
+      "  In textel menu, c toggles collapsing of materials other than the selected.",
+      "  In textel menu, / filters by name, glyph or #<mat>. Enter keeps, Esc clears.",
       "SHIFT + WASD : scrolls the texture page-wise.",
       "Space : insert selected textel preset under cursor.",
       "Z : undo.",
@@ -253,19 +851,20 @@ class Game : public t8x::GameEngine<44, 92, CharT>
       "X : export (save) work to current file.",
       "B : circle-shaped brush stroke, filled with selected textel preset.",
       "SHIFT + B : big brush-stroke.",
-      "R : randomized brush-stroke.",
-      "  Same as the B key, but fills the circle with textels according to a",
-      "  normal distribution. You can re-generate until you get the desired result.",
-      "SHIFT + R : randomized big brush-stroke.",
-      "  Same as the SHIFT + B key, but fills the circle with textels according to a",
-      "  normal distribution. You can re-generate until you get the desired result.",
-      "F : fill screen with selected preset inside current bounding box of screen.",
+      "[ ] : big brush radius. { } : big brush aspect ratio. | : big brush shape.",
+      "R / SHIFT + R : randomized (big) brush-stroke. Same as B / SHIFT + B, but fills",
+      "  according to a normal distribution. Re-generate until you get what you want.",
+      "F : fill screen with selected preset. ~ : noise fill with its mat. ! : corner.",
       "P : pick a textel from cursor and hilite the matching preset in the menu.",
       "L : show location of cursor.",
       "G : goto new cursor location.",
       "T : toggle show/hide of tracing texture.",
       "I : toggle between dark and bright textel preset modes.",
       "M : toggle show/hide of material id:s.",
+      "N / SHIFT + N : goto next cell / count cells with material of selected preset.",
+      "1 - 9 : select layer. O / SHIFT + O : toggle visibility / lock of active layer.",
+      "U : toggle memory usage panel. J : toggle keypress latency panel.",
+      "Y / SHIFT + Y : next / previous sun direction of the shading preview.",
       "SHIFT + E : edit existing or add new custom textel preset.",
       "E : edit Ad Hoc textel preset (the first in the list). Mat = -1.",
       "Q : quit. Cannot quit while any textel editing dialog is visible."
@@ -276,32 +875,46 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     dialog_keys.set_textel_str_pre({ 3, 0 }, "Esc", fg_key, bg_key);
     dialog_keys.set_textel_str_pre({ 4, 0 }, "WASD", fg_key, bg_key);
     dialog_keys.set_textel_str_pre({ 4, 8 }, "arrow keys", fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 6, 0 }, "SHIFT + WASD", fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 7, 0 }, "Space", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 8, 0 }, 'Z', fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 9, 0 }, "SHIFT + Z", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 10, 0 }, 'C', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 11, 0 }, 'V', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 12, 0 }, 'H', fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 13, 0 }, "SHIFT + V", fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 14, 0 }, "SHIFT + H", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 15, 0 }, '-', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 16, 0 }, '_', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 17, 0 }, 'X', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 18, 0 }, 'B', fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 19, 0 }, "SHIFT + B", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 20, 0 }, 'R', fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 23, 0 }, "SHIFT + R", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 26, 0 }, 'F', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 27, 0 }, 'P', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 28, 0 }, 'L', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 29, 0 }, 'G', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 30, 0 }, 'T', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 31, 0 }, 'I', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 32, 0 }, 'M', fg_key, bg_key);
-    dialog_keys.set_textel_str_pre({ 33, 0 }, "SHIFT + E", fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 34, 0 }, 'E', fg_key, bg_key);
-    dialog_keys.set_textel_pre({ 35, 0 }, 'Q', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 8, 0 }, "SHIFT + WASD", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 9, 0 }, "Space", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 10, 0 }, 'Z', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 11, 0 }, "SHIFT + Z", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 12, 0 }, 'C', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 13, 0 }, 'V', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 14, 0 }, 'H', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 15, 0 }, "SHIFT + V", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 16, 0 }, "SHIFT + H", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 17, 0 }, '-', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 18, 0 }, '_', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 19, 0 }, 'X', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 20, 0 }, 'B', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 21, 0 }, "SHIFT + B", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 22, 0 }, "[ ]", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 22, 24 }, "{ }", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 22, 54 }, '|', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 23, 0 }, 'R', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 23, 4 }, "SHIFT + R", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 25, 0 }, 'F', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 25, 38 }, '~', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 25, 67 }, '!', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 26, 0 }, 'P', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 27, 0 }, 'L', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 28, 0 }, 'G', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 29, 0 }, 'T', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 30, 0 }, 'I', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 31, 0 }, 'M', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 32, 0 }, 'N', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 32, 4 }, "SHIFT + N", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 33, 0 }, "1 - 9", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 33, 22 }, 'O', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 33, 26 }, "SHIFT + O", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 34, 0 }, 'U', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 34, 31 }, 'J', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 35, 0 }, 'Y', fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 35, 4 }, "SHIFT + Y", fg_key, bg_key);
+    dialog_keys.set_textel_str_pre({ 36, 0 }, "SHIFT + E", fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 37, 0 }, 'E', fg_key, bg_key);
+    dialog_keys.set_textel_pre({ 38, 0 }, 'Q', fg_key, bg_key);
     dialog_keys.set_tab_selection(0);
   }
   
@@ -539,6 +1152,8 @@ class Game : public t8x::GameEngine<44, 92, CharT>
   
   void reload_textel_presets()
   {
+    textur::MemScope mem_scope { textur::MemTag::Presets };
+    
     textel_presets.clear();
     custom_textel_presets.clear();
     
@@ -549,9 +1164,87 @@ class Game : public t8x::GameEngine<44, 92, CharT>
     load_textel_presets_from_file(filepath_builtin_textel_presets, textel_presets);
     
     load_textel_presets_from_file(filepath_custom_textel_presets, textel_presets, &custom_textel_presets);
+    custom_preset_file.invalidate();
     
     for (auto& tp : textel_presets)
-      tp.update_disp_strings<CharT>(t8::Style { Color16::DarkGray, Color16::Transparent2 }, true);
+      tp.invalidate_disp_strings(t8::Style { Color16::DarkGray, Color16::Transparent2 }, true);
+    
+    preset_index.rebuild(textel_presets);
+    material_groups.rebuild(textel_presets);
+    preset_search.rebuild(textel_presets);
+    preset_search.find(menu_search_query, menu_search_result);
+    shading_preview_valid.fill(false);
+  }
+  
+  // Magic Stone
+  // '%', Magenta, Cyan, 28
+  // '%', DarkMagenta, DarkCyan, 28
+  static std::vector<std::string> format_custom_textel_preset(const TextelItem& ctp)
+  {
+    auto format_textel = [](const Textel& textel)
+    {
+      return textel.glyph.str(false) + ", "
+        + textel.fg_color.str() + ", "
+        + textel.bg_color.str() + ", "
+        + std::to_string(textel.decode_raw_mat());
+    };
+    return { ctp.name, format_textel(ctp.textel_normal), format_textel(ctp.textel_shadow) };
+  }
+  
+  enum class PresetSaveResult { Patched, Rewritten, Failed };
+  
+  // Only touches the record of custom preset ctp_idx: a new preset is appended to the file and
+  //   an edited preset gets its three lines replaced, without parsing any of the other records.
+  // If the file no longer matches the presets in memory, all custom presets are written out
+  //   again instead, which loses any comments and blank lines in the file.
+  PresetSaveResult save_custom_textel_preset(int ctp_idx, bool added)
+  {
+    const auto record = format_custom_textel_preset(custom_textel_presets[ctp_idx]);
+    textur::CustomPresetFile::Result res = textur::CustomPresetFile::Result::IOError;
+    if (added)
+      res = custom_preset_file.append(filepath_custom_textel_presets, record);
+    else
+    {
+      // The presets in textel_presets are not patched yet and still hold what was last saved.
+      const auto& saved_name = textel_presets[textel_presets.size() - custom_textel_presets.size() + ctp_idx].name;
+      res = custom_preset_file.replace(filepath_custom_textel_presets, ctp_idx, record, saved_name);
+    }
+    if (res == textur::CustomPresetFile::Result::Ok)
+      return PresetSaveResult::Patched;
+    if (res == textur::CustomPresetFile::Result::IOError)
+      return PresetSaveResult::Failed;
+    
+    std::vector<std::string> lines;
+    for (const auto& ctp : custom_textel_presets)
+      for (const auto& line : format_custom_textel_preset(ctp))
+        lines.emplace_back(line);
+    custom_preset_file.invalidate();
+    return TextIO::write_file(filepath_custom_textel_presets, lines) ?
+      PresetSaveResult::Rewritten : PresetSaveResult::Failed;
+  }
+  
+  // The custom presets are the last ones in textel_presets, so patching or appending
+  //   one of them leaves the indices of all other presets intact.
+  void patch_textel_preset(int ctp_idx, bool added)
+  {
+    textur::MemScope mem_scope { textur::MemTag::Presets };
+    
+    const auto& ctp = custom_textel_presets[ctp_idx];
+    if (added)
+      textel_presets.emplace_back(ctp.textel_normal, ctp.textel_shadow, ctp.name);
+    const int idx = static_cast<int>(textel_presets.size() - custom_textel_presets.size()) + ctp_idx;
+    auto& tp = textel_presets[idx];
+    const TextelItem old_tp = tp;
+    tp.name = ctp.name;
+    tp.textel_normal = ctp.textel_normal;
+    tp.textel_shadow = ctp.textel_shadow;
+    tp.invalidate_disp_strings(t8::Style { Color16::DarkGray, Color16::Transparent2 }, true);
+    
+    preset_index.patch(textel_presets, idx, added ? nullptr : &old_tp);
+    material_groups.patch(textel_presets, idx, added ? -1 : old_tp.textel_normal.mat_raw);
+    preset_search.patch(textel_presets, idx, added ? nullptr : &old_tp);
+    preset_search.find(menu_search_query, menu_search_result);
+    shading_preview_valid.fill(false);
   }
   
 public:
@@ -562,11 +1255,16 @@ public:
     GameEngine::set_anim_rate(0, 5);
     GameEngine::set_anim_rate(1, 6);
     
+    startup_profiler.mark("engine construction");
+  
     auto bin_folder = get_exe_folder();
     filepath_custom_textel_presets = folder::join_path({ bin_folder, "custom_textel_presets" });
     filepath_builtin_textel_presets = folder::join_path({ bin_folder, "textel_presets" });
+    texture_cache.set_folder(folder::join_path({ bin_folder, "texture_cache" }));
   
     RC size;
+    
+    random_brush.set_seed(std::random_device{}());
   
     for (int a_idx = 1; a_idx < argc; ++a_idx)
     {
@@ -590,6 +1288,100 @@ public:
       }
       else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "-t") == 0) // trace
         file_path_tracing_texture = argv[a_idx + 1];
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "-l") == 0) // layer
+      {
+        Layer layer;
+        layer.file_path = argv[a_idx + 1];
+        layers.emplace_back(std::move(layer));
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--export_flattened") == 0)
+        file_path_flattened_texture = argv[a_idx + 1];
+      else if (a_idx + 2 < argc && std::strcmp(argv[a_idx], "--pack_atlas") == 0)
+      {
+        dir_atlas_sprites = argv[a_idx + 1];
+        file_path_atlas_texture = argv[a_idx + 2];
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--export_cpp_header") == 0)
+        file_path_cpp_header = argv[a_idx + 1];
+      else if (std::strcmp(argv[a_idx], "--export_cpp_header_shadow") == 0)
+        export_cpp_header_shadow = true;
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--export_ansi") == 0)
+        file_path_ansi_export = argv[a_idx + 1];
+      else if (a_idx + 2 < argc && std::strcmp(argv[a_idx], "--export_shading") == 0)
+      {
+        file_path_shading_base = argv[a_idx + 1];
+        std::istringstream iss(argv[a_idx + 2]);
+        std::string token;
+        while (std::getline(iss, token, ','))
+        {
+          textur::SunDirection dir = textur::SunDirection::Zenith;
+          if (token == "all")
+            for (int d = 0; d < static_cast<int>(textur::SunDirection::NUM_ITEMS); ++d)
+              shading_directions.emplace_back(static_cast<textur::SunDirection>(d));
+          else if (textur::parse_sun_direction(token, dir))
+            shading_directions.emplace_back(dir);
+          else
+          {
+            std::cerr << "ERROR: Unrecognized sun direction \"" << token << "\"." << std::endl;
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_shading_heights") == 0)
+      {
+        if (!shading.parse_heights(argv[a_idx + 1]))
+        {
+          std::cerr << "ERROR: Unable to parse shading heights \"" << argv[a_idx + 1] << "\"." << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      }
+      else if (std::strcmp(argv[a_idx], "--mem_report") == 0)
+        mem_report = true;
+      else if (std::strcmp(argv[a_idx], "--latency_report") == 0)
+        latency_report = true;
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--live_preview") == 0)
+        live_preview_socket_path = argv[a_idx + 1];
+      else if (std::strcmp(argv[a_idx], "--profile_startup") == 0)
+        profile_startup = true;
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--startup_budget_ms") == 0)
+        startup_budget_ms = std::stod(argv[a_idx + 1]);
+      else if (std::strcmp(argv[a_idx], "--stream_ansi") == 0)
+        stream_ansi = true;
+      else if (a_idx + 2 < argc && std::strcmp(argv[a_idx], "--import_ansi") == 0)
+      {
+        file_path_import_ansi = argv[a_idx + 1];
+        file_path_imported_texture = argv[a_idx + 2];
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_ansi_wrap_width") == 0)
+        ansi_wrap_width = std::max(0, std::atoi(argv[a_idx + 1]));
+      else if (std::strcmp(argv[a_idx], "--quantize_ansi") == 0)
+        quantize_ansi = true;
+      else if (std::strcmp(argv[a_idx], "--no_texture_cache") == 0)
+        texture_cache.set_enabled(false);
+      else if (std::strcmp(argv[a_idx], "--clear_texture_cache") == 0)
+        clear_texture_cache = true;
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_texture_cache_size_mb") == 0)
+        texture_cache.set_max_bytes(static_cast<uint64_t>(std::max(0, std::atoi(argv[a_idx + 1])))*1024*1024);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_atlas_padding") == 0)
+        atlas_padding = std::max(0, std::atoi(argv[a_idx + 1]));
+      else if (a_idx + 2 < argc && std::strcmp(argv[a_idx], "--contact_sheet") == 0)
+      {
+        dir_contact_sheet_textures = argv[a_idx + 1];
+        file_path_contact_sheet = argv[a_idx + 2];
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--lint") == 0)
+        lint_paths.emplace_back(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--lint_materials") == 0)
+      {
+        std::istringstream iss(argv[a_idx + 1]);
+        std::string token;
+        while (std::getline(iss, token, ','))
+          lint_materials.emplace_back(std::atoi(token.c_str()));
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--lint_shadow_suffix") == 0)
+        lint_shadow_suffix = argv[a_idx + 1];
+      else if (a_idx + 2 < argc && std::strcmp(argv[a_idx], "--set_thumbnail_size") == 0)
+        thumbnail_size = { std::max(1, std::atoi(argv[a_idx + 1])), std::max(1, std::atoi(argv[a_idx + 2])) };
       else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "-c") == 0) // convert to new texture
       {
         file_path_curr_texture = argv[a_idx + 1];
@@ -607,6 +1399,40 @@ public:
         big_brush_aspect_ratio = std::stof(argv[a_idx + 1]);
       else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_big_brush_radius") == 0)
         big_brush_radius = std::stof(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_random_brush_density") == 0)
+        random_brush_density = std::stof(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_random_brush_falloff") == 0)
+        random_brush_falloff = std::stof(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--seed") == 0)
+        random_brush.set_seed(std::stoull(argv[a_idx + 1]));
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_noise_fill_scale") == 0)
+        noise_fill_scale = std::stof(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_noise_fill_octaves") == 0)
+        noise_fill_octaves = std::atoi(argv[a_idx + 1]);
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_big_brush_shape") == 0)
+      {
+        if (!textur::parse_brush_shape(argv[a_idx + 1], big_brush_shape))
+        {
+          std::cerr << "ERROR: Unrecognized big brush shape \"" << argv[a_idx + 1] << "\"." << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_big_brush_stamp") == 0)
+      {
+        Texture stamp_texture;
+        if (!t8::TextureFile::load(stamp_texture, argv[a_idx + 1],
+                                   t8::TextureFileFormat::Auto,
+                                   true,
+                                   t8::AnsiLoadGlyphEncoding::Auto,
+                                   ansi_default_fg,
+                                   ansi_default_bg))
+        {
+          std::cerr << "ERROR: Unable to parse brush stamp texture file." << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        brush_engine.set_stamp(stamp_texture);
+        big_brush_shape = textur::BrushShape::Stamp;
+      }
       else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_ansi_default_fg") == 0)
       {
         if (!ansi_default_fg.parse(argv[a_idx + 1], false, true))
@@ -623,6 +1449,8 @@ public:
           exit(EXIT_FAILURE);
         }
       }
+      else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_max_used_textels") == 0)
+        used_textels.set_capacity(std::max(1, std::atoi(argv[a_idx + 1])));
       else if (a_idx + 1 < argc && std::strcmp(argv[a_idx], "--set_adhoc_textel_material") == 0)
       {
         int mat = std::atoi(argv[a_idx + 1]);
@@ -642,12 +1470,32 @@ public:
     
     msg_box_drawing_args.outline_type = t8x::OutlineType::Unicode_SingleLine;
     
+    startup_profiler.mark("argument parsing");
+    
+    if (clear_texture_cache)
+      texture_cache.clear();
+    
+    if (!file_path_atlas_texture.empty())
+      pack_atlas_and_exit();
+    if (!file_path_import_ansi.empty())
+      import_ansi_and_exit();
+    if (!file_path_contact_sheet.empty())
+      make_contact_sheet_and_exit();
+    if (!lint_paths.empty())
+      lint_and_exit();
+    
     if (file_path_curr_texture.empty())
     {
       std::cerr << "ERROR: You must supply a texture filename as a command line argument!" << std::endl;
       show_help();
       exit(EXIT_FAILURE);
     }
+    
+    if (!live_preview_socket_path.empty() && !live_preview.open(live_preview_socket_path))
+    {
+      std::cerr << "ERROR: Unable to open live preview socket \"" << live_preview_socket_path << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
       
     if (convert)
     {
@@ -671,73 +1519,128 @@ public:
     }
     else
     {
+      textur::MemScope mem_scope_textures { textur::MemTag::Textures };
       if (file_mode == EditorFileMode::NEW_OR_OVERWRITE_FILE)
         curr_texture = Texture { size };
       else
       {
-        if (!t8::TextureFile::load(curr_texture, file_path_curr_texture,
-                                   t8::TextureFileFormat::Auto,
-                                   true,
-                                   t8::AnsiLoadGlyphEncoding::Auto,
-                                   ansi_default_fg,
-                                   ansi_default_bg))
+        if (!load_texture_cached(curr_texture, file_path_curr_texture))
         {
           std::cerr << "ERROR: Unable to parse texture file." << std::endl;
           exit(EXIT_FAILURE);
         }
       }
+      startup_profiler.mark("texture load");
+      
+      // Layer 0 is the texture being edited and is always the active layer at startup.
+      layers.insert(layers.begin(), Layer {});
+      layers[0].file_path = file_path_curr_texture;
+      for (size_t layer_idx = 1; layer_idx < layers.size(); ++layer_idx)
+      {
+        auto& layer = layers[layer_idx];
+        if (!folder::exists(layer.file_path))
+          layer.texture = Texture { curr_texture.size };
+        else if (!load_texture_cached(layer.texture, layer.file_path))
+        {
+          std::cerr << "ERROR: Unable to parse layer texture file \"" << layer.file_path << "\"." << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      }
+      
+      startup_profiler.mark("layer load");
       
+      textur::MemScope mem_scope_tracing { textur::MemTag::Tracing };
       if (!file_path_tracing_texture.empty())
-        if (!t8::TextureFile::load(tracing_texture, file_path_tracing_texture,
-                                   t8::TextureFileFormat::Auto,
-                                   true,
-                                   t8::AnsiLoadGlyphEncoding::Auto,
-                                   ansi_default_fg,
-                                   ansi_default_bg))
+        if (!load_texture_cached(tracing_texture, file_path_tracing_texture))
         {
           std::cerr << "ERROR: Unable to parse texture file." << std::endl;
           exit(EXIT_FAILURE);
         }
+      startup_profiler.mark("tracing texture load");
     }
   }
   
+  void report_memory() const
+  {
+    if (!mem_report)
+      return;
+    std::cout << "Memory report:" << std::endl;
+    for (const auto& line : textur::format_memory_report())
+      std::cout << "  " << line << std::endl;
+  }
+  
+  void report_latency() const
+  {
+    if (!latency_report)
+      return;
+    std::cout << "Keypress to screen update latency:" << std::endl;
+    for (const auto& line : key_latency.format())
+      std::cout << "  " << line << std::endl;
+  }
+  
+  // Returns false if the time to first frame exceeded the startup budget.
+  bool report_startup_profile() const
+  {
+    if (!profile_startup)
+      return true;
+    startup_profiler.print(std::cout);
+    if (startup_budget_ms > 0. && startup_profiler.total_ms() > startup_budget_ms)
+    {
+      std::cerr << "ERROR: Time to first frame exceeded the budget of " << startup_budget_ms << " ms." << std::endl;
+      return false;
+    }
+    return true;
+  }
+  
   virtual void generate_data() override
   {
+    startup_profiler.mark("terminal init");
+  
     reload_textel_presets();
+    startup_profiler.mark("textel preset load");
                                 
     if (convert)
     {
-      t8::TextureFile::load(bright_texture, file_path_bright_texture, // source
-                            t8::TextureFileFormat::Auto,
-                            true,
-                            t8::AnsiLoadGlyphEncoding::Auto,
-                            ansi_default_fg,
-                            ansi_default_bg);
-      curr_texture = Texture { bright_texture.size }; // target
-      for (int r = 0; r < bright_texture.size.r; ++r)
-      {
-        for (int c = 0; c < bright_texture.size.c; ++c)
-        {
-          const auto& curr_textel = bright_texture(r, c);
-          auto it = stlutils::find_if(textel_presets, [&curr_textel](const auto& tp)
-          {
-            return tp.textel_normal.glyph == curr_textel.glyph
-            && tp.textel_normal.fg_color == curr_textel.fg_color
-            && tp.textel_normal.bg_color == curr_textel.bg_color
-            && tp.textel_normal.mat_raw == curr_textel.mat_raw;
-          });
-          if (it != textel_presets.end())
-            curr_texture.set_textel(r, c, it->textel_shadow);
-          else
-            curr_texture.set_textel(r, c, curr_textel);
-        }
-      }
-      t8::TextureFile::save(curr_texture, file_path_curr_texture,
-                            t8::TextureFileFormat::Auto,
-                            true,
-                            save_textures_as_ascii_only ?
-                              t8::TxGlyphEncoding::AsciiOnly :
-                              t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly);
+      {
+        textur::MemScope mem_scope { textur::MemTag::Bright };
+        if (!load_texture_cached(bright_texture, file_path_bright_texture)) // source
+        {
+          std::cerr << "ERROR: Unable to parse texture file \"" << file_path_bright_texture << "\"." << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      }
+      quantize_ansi_textures();
+      textur::MemScope mem_scope { textur::MemTag::Textures };
+      curr_texture = convert_to_shadow(bright_texture); // target
+      t8::TextureFile::save(curr_texture, file_path_curr_texture,
+                            t8::TextureFileFormat::Auto,
+                            true,
+                            save_textures_as_ascii_only ?
+                              t8::TxGlyphEncoding::AsciiOnly :
+                              t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly);
+      request_exit();
+      return;
+    }
+    
+    quantize_ansi_textures();
+
+    if (!file_path_cpp_header.empty())
+    {
+      export_cpp_header();
+      request_exit();
+      return;
+    }
+    
+    if (!file_path_ansi_export.empty())
+    {
+      export_ansi();
+      request_exit();
+      return;
+    }
+    
+    if (!file_path_shading_base.empty())
+    {
+      export_shading();
       request_exit();
       return;
     }
@@ -749,12 +1652,136 @@ public:
     
     reset_goto_input();
     init_keys_legend();
+    startup_profiler.mark("keys legend");
     
     reset_textel_editor(true);
     reset_adhoc_textel_editor(true);
+    startup_profiler.mark("textel editor dialogs");
+    
+    material_occupancy.rebuild(curr_texture);
+    startup_profiler.mark("material occupancy");
+    
+    if (ansi_stream_stats.num_bytes > 0)
+    {
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(2);
+      oss << "Streamed " << ansi_stream_stats.num_bytes/1e6 << " MB of ANSI art at "
+          << ansi_stream_stats.mb_per_s() << " MB/s";
+      message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                   oss.str(),
+                                   t8x::MessageHandlerLevel::Guide);
+    }
+    if (quantize_stats.num_unique > 0)
+    {
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(2);
+      oss << "Quantized " << quantize_stats.num_cells << " cells of ANSI art to textel presets in "
+          << quantize_stats.seconds << " s";
+      message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                   oss.str(),
+                                   t8x::MessageHandlerLevel::Guide);
+    }
   }
   
 private:
+  // The shadow textel of the preset whose normal textel matches, else the textel itself.
+  const Textel& shadow_of(const Textel& textel) const
+  {
+    const auto preset_idx = preset_index.find_normal(textel_presets, textel);
+    return 0 <= preset_idx ? textel_presets[preset_idx].textel_shadow : textel;
+  }
+  
+  // Replaces every textel that matches the normal textel of a preset with the shadow textel of that preset.
+  Texture convert_to_shadow(const Texture& bright_texture) const
+  {
+    Texture dark_texture { bright_texture.size };
+    for (int r = 0; r < bright_texture.size.r; ++r)
+      for (int c = 0; c < bright_texture.size.c; ++c)
+        dark_texture.set_textel(r, c, shadow_of(bright_texture(r, c)));
+    return dark_texture;
+  }
+  
+  Texture shade_visible_layers(textur::SunDirection dir) const
+  {
+    return shading.shade(textur::flatten_stack(visible_layers()), dir,
+                         [this](const Textel& textel) { return shadow_of(textel); });
+  }
+  
+  void export_shading() const
+  {
+    const std::filesystem::path base { file_path_shading_base };
+    for (const auto dir : shading_directions)
+    {
+      const auto file_path = base.parent_path() / (base.stem().string() + "_" + textur::to_string(dir) + base.extension().string());
+      if (!save_texture(shade_visible_layers(dir), file_path.string()))
+      {
+        std::cerr << "ERROR: Unable to write shaded texture file \"" << file_path.string() << "\"." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  
+  // Each direction is only shaded again once the texture or the visible layers have changed.
+  const Texture& get_shading_preview()
+  {
+    const auto d = static_cast<size_t>(shading_preview_dir);
+    if (!shading_preview_valid[d])
+    {
+      shading_previews[d] = shade_visible_layers(shading_preview_dir);
+      shading_preview_valid[d] = true;
+      viewport_cache.invalidate();
+    }
+    return shading_previews[d];
+  }
+  
+  void export_cpp_header()
+  {
+    std::vector<Texture> dark_textures(layers.size());
+    std::vector<textur::CppExportTexture> textures;
+    for (int layer_idx = 0; layer_idx < static_cast<int>(layers.size()); ++layer_idx)
+    {
+      textur::CppExportTexture tex;
+      tex.name = std::filesystem::path(layers[layer_idx].file_path).stem().string();
+      tex.normal = &layer_texture(layer_idx);
+      if (export_cpp_header_shadow)
+      {
+        dark_textures[layer_idx] = convert_to_shadow(*tex.normal);
+        tex.shadow = &dark_textures[layer_idx];
+      }
+      textures.emplace_back(tex);
+    }
+    
+    textur::CppHeaderExport header_export;
+    if (!header_export.write(file_path_cpp_header, textures))
+    {
+      std::cerr << "ERROR: Unable to write C++ header file \"" << file_path_cpp_header << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  
+  // Sends this frame's edits, composited over the visible layers, as one batch.
+  void publish_live_preview()
+  {
+    if (!live_preview.is_open())
+      return;
+    const auto stack = visible_layers();
+    live_preview.flush(textur::stack_extent(stack),
+                       [&stack](int r, int c) { return textur::composite_stack(stack, r, c); });
+  }
+
+  void export_ansi() const
+  {
+    textur::AnsiExport ansi_export { ansi_default_fg, ansi_default_bg, save_textures_as_ascii_only };
+    if (!ansi_export.write(file_path_ansi_export, textur::flatten_stack(visible_layers())))
+    {
+      std::cerr << "ERROR: Unable to write ANSI file \"" << file_path_ansi_export << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const auto& stats = ansi_export.get_stats();
+    std::cout << "Exported " << stats.num_bytes << " bytes (" << stats.num_bytes_naive
+              << " bytes with per-cell escape sequences)." << std::endl;
+  }
+  
   Textel selected_textel() const
   {
     return textel_presets[selected_textel_preset_idx].get_textel(use_shadow_textels);
@@ -762,54 +1789,234 @@ private:
 
   void select_textel(const Textel& textel)
   {
-    const auto idx_normal = stlutils::find_if_idx(textel_presets,
-      [&textel](const auto& preset) { return preset.get_textel(false) == textel; });
-    const auto idx_shadow = stlutils::find_if_idx(textel_presets,
-      [&textel](const auto& preset) { return preset.get_textel(true) == textel; });
-    const auto preset_idx = 0 <= idx_normal ? idx_normal : idx_shadow;
+    clear_menu_search();
+    const auto preset_idx = preset_index.find_any(textel_presets, textel);
 
     if (0 <= preset_idx)
     {
       selected_textel_preset_idx = preset_idx;
-      menu_r_offs = -3*selected_textel_preset_idx;
+      menu_r_offs = -3*menu_slot_of(selected_textel_preset_idx);
       return;
     }
 
     selected_textel_preset_idx = 0;
     textel_presets[0].textel_normal = textel;
     textel_presets[0].textel_shadow = textel;
-    textel_presets[0].update_disp_strings<CharT>({ Color16::DarkGray, Color16::Transparent2 }, false);
+    textel_presets[0].invalidate_disp_strings({ Color16::DarkGray, Color16::Transparent2 }, false);
     reset_adhoc_textel_editor();
   }
 
   void select_used_textel()
   {
-    if (!stlutils::in_range(used_textels, selected_used_textel_idx))
+    if (selected_used_textel_idx < 0 || selected_used_textel_idx >= static_cast<int>(used_textels.size()))
       return;
 
-    select_textel(used_textels[selected_used_textel_idx]);
+    select_textel(used_textels.at(selected_used_textel_idx));
   }
 
   void record_used_textel(const Textel& textel)
   {
-    auto it = stlutils::find_if(used_textels,
-      [&textel](const auto& used_textel) { return used_textel == textel; });
-
-    if (it != used_textels.end())
-      used_textels.erase(it);
-    used_textels.insert(used_textels.begin(), textel);
-    if (used_textels.size() > max_used_textels)
-      used_textels.pop_back();
+    textur::MemScope mem_scope { textur::MemTag::UsedTextels };
+    used_textels.promote(textel);
 
     selected_used_textel_idx = 0;
     menu_r_offs_ut = 0;
   }
 
+  // One undo / redo step. Edits keep the previous textel of each cell they touch, except for
+  //   a rectangle filled in one go (the noise fill), which keeps its previous contents as a
+  //   CompactRegion. That takes a byte or two per cell.
+  struct UndoItem
+  {
+    std::vector<std::pair<t8::RC, Textel>,
+      textur::TagAllocator<std::pair<t8::RC, Textel>, textur::MemTag::UndoRedo>> cells;
+    RC region_pos { 0, 0 };
+    textur::CompactRegion region {};
+  };
+  
+  // Applies an undo or redo step and returns the step that reverts it.
+  UndoItem apply_undo_item(const UndoItem& item)
+  {
+    UndoItem inverse;
+    inverse.cells.reserve(item.cells.size());
+    for (const auto& cell : item.cells)
+      inverse.cells.emplace_back(cell.first, curr_texture(cell.first));
+    for (const auto& cell : item.cells)
+      set_curr_textel(cell.first, cell.second);
+    if (!item.region.empty())
+    {
+      {
+        textur::MemScope mem_scope { textur::MemTag::UndoRedo };
+        inverse.region_pos = item.region_pos;
+        inverse.region = item.region.swap_into(curr_texture, item.region_pos);
+      }
+      mark_region_edited(item.region_pos, inverse.region, item.region);
+    }
+    return inverse;
+  }
+  
+  // Fills the rectangle spanned by the noise fill corner and the cursor (or the part of the
+  //   texture on screen, as F does, if no corner is set) with the presets of the material
+  //   of the selected preset, picked by value noise. The whole fill is a single undo step.
+  void noise_fill(int nri, int nci)
+  {
+    RC pos = RC { 0, 0 } - screen_pos;
+    RC end = pos + RC { nri, nci };
+    if (noise_fill_corner_set)
+    {
+      pos = { std::min(noise_fill_corner.r, cursor_pos.r), std::min(noise_fill_corner.c, cursor_pos.c) };
+      end = RC { std::max(noise_fill_corner.r, cursor_pos.r), std::max(noise_fill_corner.c, cursor_pos.c) } + RC { 1, 1 };
+      noise_fill_corner_set = false;
+    }
+    pos = { std::max(0, pos.r), std::max(0, pos.c) };
+    end = { std::min(curr_texture.size.r, end.r), std::min(curr_texture.size.c, end.c) };
+    const RC size { std::max(0, end.r - pos.r), std::max(0, end.c - pos.c) };
+    if (size.r == 0 || size.c == 0)
+      return;
+    
+    const auto t0 = std::chrono::steady_clock::now();
+    const int group = material_groups.group(selected_textel_preset_idx);
+    const int first_preset_idx = material_groups.group_start(group);
+    const int num_presets = std::min(256, material_groups.group_size(group));
+    textur::ValueNoise noise { random_brush.get_seed(), noise_fill_scale, noise_fill_octaves };
+    std::vector<Textel> textels;
+    for (int i = 0; i < num_presets; ++i)
+      textels.emplace_back(textel_presets[first_preset_idx + i].get_textel(use_shadow_textels));
+    const textur::CompactRegion fill { size, std::move(textels), textur::noise_bands(noise, pos, size, num_presets) };
+    
+    UndoItem undo;
+    {
+      textur::MemScope mem_scope { textur::MemTag::UndoRedo };
+      undo.region_pos = pos;
+      undo.region = fill.swap_into(curr_texture, pos);
+    }
+    mark_region_edited(pos, undo.region, fill);
+    record_used_textel(selected_textel());
+    undo_buffer.push(std::move(undo));
+    redo_buffer = {};
+    is_modified = true;
+    
+    const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::ostringstream oss;
+    oss << "Noise filled " << size.r << " x " << size.c << " cells with " << num_presets
+        << " presets of material " << material_groups.group_material(group) << " in " << static_cast<int>(ms) << " ms";
+    message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                 oss.str(),
+                                 t8x::MessageHandlerLevel::Guide);
+  }
+  
+  // Bookkeeping for a rectangle of the current texture that has been overwritten with
+  //   new_region, old_region holding what was there before. Done once for the whole rectangle
+  //   since doing it cell by cell through set_curr_textel() dominates the time of large fills.
+  void mark_region_edited(const RC& pos, const textur::CompactRegion& old_region, const textur::CompactRegion& new_region)
+  {
+    material_occupancy.update_region(pos, old_region, new_region);
+    viewport_cache.invalidate();
+    live_preview.mark_dirty(pos, old_region.size());
+    shading_preview_valid.fill(false);
+  }
+  
+  // All edits of the current texture go through here (or through mark_region_edited() for
+  //   rectangles) so that cached views stay in sync.
+  void set_curr_textel(const RC& pos, const Textel& textel)
+  {
+    if (!math::in_range(pos.r, 0, curr_texture.size.r, Range::ClosedOpen)
+        || !math::in_range(pos.c, 0, curr_texture.size.c, Range::ClosedOpen))
+      return;
+    material_occupancy.update(pos, curr_texture(pos).mat_raw, textel.mat_raw);
+    curr_texture.set_textel(pos, textel);
+    viewport_cache.mark_dirty(pos);
+    live_preview.mark_dirty(pos);
+    shading_preview_valid.fill(false);
+  }
+
+  void show_big_brush_message()
+  {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2);
+    oss << "Big brush : " << textur::to_string(big_brush_shape);
+    if (big_brush_shape != textur::BrushShape::Stamp)
+      oss << ", radius = " << big_brush_radius << ", aspect ratio = " << big_brush_aspect_ratio;
+    message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                 oss.str(),
+                                 t8x::MessageHandlerLevel::Guide);
+  }
+
   std::string fallback_to_text_field_input(char fb) const
   {
     return fb == t8::Glyph::none ? "" : std::string(1, fb);
   }
   
+  // Same as the material jumps of the textel menu, but among the search results only.
+  int filtered_group_jump(bool left) const
+  {
+    const int num_slots = menu_num_slots();
+    int slot_idx = menu_slot_of(selected_textel_preset_idx);
+    if (slot_idx >= num_slots)
+      return -1;
+    const int g = material_groups.group(menu_search_result[slot_idx]);
+    const int step = left ? -1 : +1;
+    for (slot_idx += step; 0 <= slot_idx && slot_idx < num_slots; slot_idx += step)
+    {
+      if (material_groups.group(menu_search_result[slot_idx]) != g)
+        return menu_search_result[slot_idx];
+    }
+    return -1;
+  }
+
+  const Texture& layer_texture(int layer_idx) const
+  {
+    return layer_idx == active_layer ? curr_texture : layers[layer_idx].texture;
+  }
+  
+  bool active_layer_locked() const
+  {
+    return layers[active_layer].locked;
+  }
+  
+  // The active layer is checked out into curr_texture, undo_buffer and redo_buffer
+  //   so that all the editing code keeps working on those.
+  void set_active_layer(int layer_idx)
+  {
+    if (layer_idx == active_layer)
+      return;
+    auto swap_layer = [this](Layer& layer)
+    {
+      std::swap(curr_texture, layer.texture);
+      std::swap(undo_buffer, layer.undo_buffer);
+      std::swap(redo_buffer, layer.redo_buffer);
+    };
+    swap_layer(layers[active_layer]);
+    active_layer = layer_idx;
+    swap_layer(layers[active_layer]);
+    
+    cursor_pos.r = math::clamp(cursor_pos.r, 0, std::max(0, curr_texture.size.r - 1));
+    cursor_pos.c = math::clamp(cursor_pos.c, 0, std::max(0, curr_texture.size.c - 1));
+    material_occupancy.rebuild(curr_texture);
+    if (show_materials)
+      viewport_cache.invalidate();
+  }
+  
+  // Front to back.
+  std::vector<const Texture*> visible_layers() const
+  {
+    std::vector<const Texture*> stack;
+    for (int layer_idx = static_cast<int>(layers.size()) - 1; layer_idx >= 0; --layer_idx)
+      if (layers[layer_idx].visible)
+        stack.emplace_back(&layer_texture(layer_idx));
+    return stack;
+  }
+  
+  bool save_texture(const Texture& texture, const std::string& file_path) const
+  {
+    return t8::TextureFile::save(texture, file_path,
+                                 t8::TextureFileFormat::Auto,
+                                 true,
+                                 save_textures_as_ascii_only ?
+                                   t8::TxGlyphEncoding::AsciiOnly :
+                                   t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly);
+  }
+  
   // Sets the cursor and centers the view.
   void set_cursor(const RC& pos, int nri, int nci)
   {
@@ -826,6 +2033,28 @@ private:
   void handle_editor_key_presses(char curr_key, t8::SpecialKey curr_special_key,
                                  int nri, int nci, t8::RC& cursor_pos)
   {
+    if (show_menu && menu_search_typing)
+    {
+      if (curr_special_key == t8::SpecialKey::Enter)
+        menu_search_typing = false;
+      else if (curr_special_key == t8::SpecialKey::Escape)
+        clear_menu_search();
+      else if (curr_special_key == t8::SpecialKey::Backspace)
+      {
+        if (!menu_search_query.empty())
+        {
+          menu_search_query.pop_back();
+          update_menu_search();
+        }
+      }
+      else if (32 <= curr_key && curr_key < 127)
+      {
+        menu_search_query += curr_key;
+        update_menu_search();
+      }
+      return;
+    }
+  
     if (curr_key == '-')
     {
       if (math::toggle(show_menu))
@@ -847,46 +2076,42 @@ private:
     bool is_right = curr_special_key == t8::SpecialKey::Right || curr_key == 'd';
     if (show_menu)
     {
-      if (is_up)
+      if ((is_up || is_down) && menu_num_slots() > 0)
       {
-        selected_textel_preset_idx--;
-        if (selected_textel_preset_idx == -1)
-        {
-          selected_textel_preset_idx = static_cast<int>(textel_presets.size()) - 1;
-          menu_r_offs = nri - 3*static_cast<int>(textel_presets.size());
-        }
+        const int num_slots = menu_num_slots();
+        int slot_idx = menu_slot_of(selected_textel_preset_idx) + (is_up ? -1 : +1);
+        if (slot_idx == -1)
+          slot_idx = num_slots - 1;
+        else if (slot_idx == num_slots)
+          slot_idx = 0;
+        selected_textel_preset_idx = menu_slot(slot_idx).preset_idx;
+        if (slot_idx == 0)
+          menu_r_offs = 0;
+        else if (is_up && slot_idx == num_slots - 1)
+          menu_r_offs = nri - 3*menu_num_slots();
       }
-      else if (is_down)
+      else if (is_left || is_right)
       {
-        selected_textel_preset_idx++;
-        if (selected_textel_preset_idx == static_cast<int>(textel_presets.size()))
+        const int idx = menu_filtered() ?
+          filtered_group_jump(is_left) :
+          is_left ?
+            material_groups.prev_group_last(selected_textel_preset_idx) :
+            material_groups.next_group_start(selected_textel_preset_idx);
+        if (0 <= idx)
         {
-          selected_textel_preset_idx = 0;
-          menu_r_offs = 0;
+          selected_textel_preset_idx = idx;
+          menu_r_offs = -3*menu_slot_of(selected_textel_preset_idx);
         }
       }
-      else if (is_left)
-      {
-        int curr_mat = textel_presets[selected_textel_preset_idx].textel_normal.decode_raw_mat();
-        for (int idx = selected_textel_preset_idx - 1; idx >= 0; --idx)
-          if (textel_presets[idx].textel_normal.decode_raw_mat() != curr_mat)
-          {
-            selected_textel_preset_idx = idx;
-            menu_r_offs = -3*selected_textel_preset_idx;
-            break;
-          }
-      }
-      else if (is_right)
+      else if (curr_key == 'c')
       {
-        int curr_mat = textel_presets[selected_textel_preset_idx].textel_normal.decode_raw_mat();
-        for (int idx = selected_textel_preset_idx + 1; idx < static_cast<int>(textel_presets.size()); ++idx)
-          if (textel_presets[idx].textel_normal.decode_raw_mat() != curr_mat)
-          {
-            selected_textel_preset_idx = idx;
-            menu_r_offs = -3*selected_textel_preset_idx;
-            break;
-          }
+        math::toggle(menu_group_by_material);
+        menu_r_offs = -3*menu_slot_of(selected_textel_preset_idx);
       }
+      else if (curr_key == '/')
+        menu_search_typing = true;
+      else if (curr_special_key == t8::SpecialKey::Escape && menu_filtered())
+        clear_menu_search();
     }
     else if (show_menu_used_textels)
     {
@@ -896,7 +2121,7 @@ private:
       }
       else if (is_down && !used_textels.empty())
       {
-        selected_used_textel_idx = std::min(stlutils::sizeI(used_textels) - 1,
+        selected_used_textel_idx = std::min(static_cast<int>(used_textels.size()) - 1,
                                             selected_used_textel_idx + 1);
       }
       else if ((curr_key == ' ' || curr_special_key == t8::SpecialKey::Enter)
@@ -972,11 +2197,17 @@ private:
         while (cursor_pos.c + screen_pos.c >= nci)
           screen_pos.c--;
       }
+      else if (active_layer_locked() && std::string(" zZcCbBrRfF~").find(curr_key) != std::string::npos)
+      {
+        message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                     "Layer " + std::to_string(active_layer + 1) + " is locked.",
+                                     t8x::MessageHandlerLevel::Guide);
+      }
       else if (curr_key == ' ')
       {
         const auto textel = selected_textel();
-        undo_buffer.push({ { cursor_pos, curr_texture(cursor_pos) } });
-        curr_texture.set_textel(cursor_pos, textel);
+        undo_buffer.push({ { { cursor_pos, curr_texture(cursor_pos) } } });
+        set_curr_textel(cursor_pos, textel);
         record_used_textel(textel);
         redo_buffer = {};
         is_modified = true;
@@ -985,14 +2216,7 @@ private:
       {
         if (!undo_buffer.empty())
         {
-          const auto& upv = undo_buffer.top();
-          UndoItem item;
-          item.reserve(upv.size());
-          for (const auto& up : upv)
-            item.emplace_back(up.first, curr_texture(up.first));
-          redo_buffer.push(item);
-          for (const auto& up : upv)
-            curr_texture.set_textel(up.first, up.second);
+          redo_buffer.push(apply_undo_item(undo_buffer.top()));
           undo_buffer.pop();
           is_modified = true;
         }
@@ -1001,14 +2225,7 @@ private:
       {
         if (!redo_buffer.empty())
         {
-          const auto& upv = redo_buffer.top();
-          UndoItem item;
-          item.reserve(upv.size());
-          for (const auto& up : upv)
-            item.emplace_back(up.first, curr_texture(up.first));
-          undo_buffer.push(item);
-          for (const auto& up : upv)
-            curr_texture.set_textel(up.first, up.second);
+          undo_buffer.push(apply_undo_item(redo_buffer.top()));
           redo_buffer.pop();
           is_modified = true;
         }
@@ -1023,64 +2240,50 @@ private:
         math::toggle(draw_vert_coord_line);
       else if (str::to_lower(curr_key) == 'c')
       {
-        undo_buffer.push({ { cursor_pos, curr_texture(cursor_pos) } });
-        curr_texture.set_textel(cursor_pos, Textel {});
+        undo_buffer.push({ { { cursor_pos, curr_texture(cursor_pos) } } });
+        set_curr_textel(cursor_pos, Textel {});
         redo_buffer = {};
         is_modified = true;
       }
-      else if (curr_key == 'b' || curr_key == 'r')
+      else if (str::to_lower(curr_key) == 'b' || str::to_lower(curr_key) == 'r')
       {
+        const bool big = curr_key == 'B' || curr_key == 'R';
+        const bool randomized = str::to_lower(curr_key) == 'r';
+        const auto& mask = big ?
+          brush_engine.get_mask(big_brush_shape, big_brush_radius, big_brush_aspect_ratio) :
+          brush_engine.small_mask();
+        if (randomized)
+          random_brush.generate(mask, random_brush_density, random_brush_falloff, random_brush_accept);
         const auto textel = selected_textel();
         UndoItem undo;
-        for (int i = -2; i <= 2; ++i)
+        textur::apply_mask(mask, cursor_pos, curr_texture.size, [&](const RC& pos, int cell_idx)
         {
-          int j_offs = std::abs(i) == 2 ? 2 : 4;
-          for (int j = -j_offs; j <= j_offs + 1; ++j)
-          {
-            RC pos = cursor_pos + RC { i, j };
-            auto dist = math::length(2.f*i, static_cast<float>(j));
-            auto nrnd = rnd::randn(0.f, dist);
-            auto anrnd = std::abs(nrnd);
-            if (curr_key == 'b' || (curr_key == 'r' && anrnd < 0.1f))
-            {
-              undo.emplace_back(pos, curr_texture(pos));
-              curr_texture.set_textel(pos, textel);
-            }
-          }
-        }
-        if (!undo.empty())
+          if (randomized && !random_brush_accept[cell_idx])
+            return;
+          undo.cells.emplace_back(pos, curr_texture(pos));
+          set_curr_textel(pos, textel);
+        });
+        if (!undo.cells.empty())
           record_used_textel(textel);
         undo_buffer.push(undo);
         redo_buffer = {};
         is_modified = true;
       }
-      else if (curr_key == 'B' || curr_key == 'R')
+      else if (curr_key == '[' || curr_key == ']')
       {
-        const auto textel = selected_textel();
-        UndoItem undo;
-        auto positions = t8x::filled_circle_positions(cursor_pos, big_brush_radius, big_brush_aspect_ratio);
-        for (const auto& p : positions)
-        {
-          float anrnd = 0.f;
-          if (curr_key == 'R')
-          {
-            int i = p.r - cursor_pos.r;
-            int j = p.c - cursor_pos.c;
-            auto dist = math::length(2.f*i, static_cast<float>(j));
-            auto nrnd = rnd::randn(0.f, dist);
-            anrnd = std::abs(nrnd);
-          }
-          if (anrnd < 0.1f)
-          {
-            undo.emplace_back(p, curr_texture(p));
-            curr_texture.set_textel(p, textel);
-          }
-        }
-        if (!undo.empty())
-          record_used_textel(textel);
-        undo_buffer.push(undo);
-        redo_buffer = {};
-        is_modified = true;
+        big_brush_radius = std::max(0.5f, big_brush_radius + (curr_key == '[' ? -0.5f : 0.5f));
+        show_big_brush_message();
+      }
+      else if (curr_key == '{' || curr_key == '}')
+      {
+        big_brush_aspect_ratio = std::max(0.1f, big_brush_aspect_ratio + (curr_key == '{' ? -0.04f : 0.04f));
+        show_big_brush_message();
+      }
+      else if (curr_key == '|')
+      {
+        const int num_shapes = static_cast<int>(textur::BrushShape::NUM_ITEMS) - (brush_engine.has_stamp() ? 0 : 1);
+        big_brush_shape = static_cast<textur::BrushShape>((static_cast<int>(big_brush_shape) + 1) % num_shapes);
+        show_big_brush_message();
       }
       else if (str::to_lower(curr_key) == 'f')
       {
@@ -1091,16 +2294,26 @@ private:
           for (int j = 0; j < nci; ++j)
           {
             RC pos = RC { i, j } - screen_pos;
-            undo.emplace_back(pos, curr_texture(pos));
-            curr_texture.set_textel(pos, textel);
+            undo.cells.emplace_back(pos, curr_texture(pos));
+            set_curr_textel(pos, textel);
           }
         }
-        if (!undo.empty())
+        if (!undo.cells.empty())
           record_used_textel(textel);
         undo_buffer.push(undo);
         redo_buffer = {};
         is_modified = true;
       }
+      else if (curr_key == '!')
+      {
+        noise_fill_corner = cursor_pos;
+        noise_fill_corner_set = true;
+        message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                     "Noise fill corner @ " + cursor_pos.str(),
+                                     t8x::MessageHandlerLevel::Guide);
+      }
+      else if (curr_key == '~')
+        noise_fill(nri, nci);
       else if (str::to_lower(curr_key) == 'p')
         select_textel(curr_texture(cursor_pos));
       else if (str::to_lower(curr_key) == 'l')
@@ -1146,9 +2359,63 @@ private:
         }
       }
       else if (str::to_lower(curr_key) == 't')
+      {
         math::toggle(show_tracing);
+        viewport_cache.invalidate();
+      }
       else if (str::to_lower(curr_key) == 'm')
+      {
         math::toggle(show_materials);
+        viewport_cache.invalidate();
+      }
+      else if ('1' <= curr_key && curr_key <= '9')
+      {
+        const int layer_idx = curr_key - '1';
+        if (layer_idx < static_cast<int>(layers.size()))
+          set_active_layer(layer_idx);
+      }
+      else if (curr_key == 'o')
+      {
+        math::toggle(layers[active_layer].visible);
+        viewport_cache.invalidate();
+        live_preview.mark_all_dirty();
+        shading_preview_valid.fill(false);
+      }
+      else if (curr_key == 'O')
+        math::toggle(layers[active_layer].locked);
+      else if (str::to_lower(curr_key) == 'u')
+        math::toggle(show_mem_panel);
+      else if (str::to_lower(curr_key) == 'j')
+        math::toggle(show_latency_panel);
+      else if (str::to_lower(curr_key) == 'y')
+      {
+        const int num_dirs = static_cast<int>(textur::SunDirection::NUM_ITEMS);
+        const int step = curr_key == 'y' ? 1 : num_dirs - 1;
+        shading_preview_dir = static_cast<textur::SunDirection>((static_cast<int>(shading_preview_dir) + step) % num_dirs);
+        viewport_cache.invalidate();
+        message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                     "Shading preview : sun at " + textur::to_string(shading_preview_dir),
+                                     t8x::MessageHandlerLevel::Guide);
+      }
+      else if (curr_key == 'n')
+      {
+        const auto mat_raw = selected_textel().mat_raw;
+        RC pos;
+        if (material_occupancy.find_next(mat_raw, cursor_pos, pos))
+          set_cursor(pos, nri, nci);
+        else
+          message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                       "No cells with material " + std::to_string(selected_textel().decode_raw_mat()) + " found.",
+                                       t8x::MessageHandlerLevel::Guide);
+      }
+      else if (curr_key == 'N')
+      {
+        const auto textel = selected_textel();
+        message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                     "Material " + std::to_string(textel.decode_raw_mat()) + " : "
+                                     + std::to_string(material_occupancy.count(textel.mat_raw)) + " cells.",
+                                     t8x::MessageHandlerLevel::Guide);
+      }
     }
     
     if (str::to_lower(curr_key) == 'i')
@@ -1175,12 +2442,15 @@ private:
         
       if (safe_to_save)
       {
-        if (t8::TextureFile::save(curr_texture, file_path_output,
-                                  t8::TextureFileFormat::Auto,
-                                  true,
-                                  save_textures_as_ascii_only ?
-                                    t8::TxGlyphEncoding::AsciiOnly :
-                                    t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly))
+        // One file per layer, and optionally the visible layers flattened into one file.
+        bool saved = save_texture(layer_texture(0), file_path_output);
+        for (int layer_idx = 1; layer_idx < static_cast<int>(layers.size()); ++layer_idx)
+          saved = save_texture(layer_texture(layer_idx), layers[layer_idx].file_path) && saved;
+        if (!file_path_flattened_texture.empty())
+        {
+          saved = save_texture(textur::flatten_stack(visible_layers()), file_path_flattened_texture) && saved;
+        }
+        if (saved)
         {
           message_handler->add_message(static_cast<float>(get_real_time_s()),
                                        "Your work was successfully saved.",
@@ -1203,6 +2473,13 @@ private:
 
   virtual void update() override
   {
+    // Keys are polled just before update() is called, so the start of an update is when they
+    //   were received.
+    const auto update_start_time = std::chrono::steady_clock::now();
+    
+    if (num_updates == 0)
+      startup_profiler.mark("engine loop start");
+  
     t8::Style ui_style { Color16::LightGray, Color16::Black };
     
     int cursor_anim_ctr = get_anim_count(1) % 2 == 0;
@@ -1228,6 +2505,7 @@ private:
     auto curr_key = get_char_key(kpdp.transient);
     auto curr_special_key = get_special_key(kpdp.transient);
     bool allow_editing = true;
+    const bool key_received = (0 < curr_key && curr_key < 127) || curr_special_key != t8::SpecialKey::None;
       
     if (!show_confirm_overwrite)
     {
@@ -1239,6 +2517,13 @@ private:
   
     if (is_modified)
       sh.write_buffer("*", 0, 0, Color16::Red, Color16::White);
+    if (layers.size() > 1)
+    {
+      const auto& layer = layers[active_layer];
+      sh.write_buffer("Layer " + std::to_string(active_layer + 1) + "/" + std::to_string(layers.size())
+                      + (layer.visible ? "" : " hidden") + (layer.locked ? " locked" : ""),
+                      0, 2, Color16::Black, Color16::White);
+    }
     draw_frame(sh, Color16::White);
     
     message_handler->update(sh, static_cast<float>(get_real_time_s()), msg_box_drawing_args);
@@ -1640,32 +2925,28 @@ private:
                   if (!edit_textel_presets_as_ascii_only && gp_textel_symbol != nullptr)
                     gp_textel_symbol->push_recent();
                 
-                  std::vector<std::string> lines_custom_textel_presets;
-                  for (const auto& ctp : custom_textel_presets)
+                  const bool added = edit_or_add == EditOrAdd::Add;
+                  const int ctp_idx = added ? stlutils::sizeI(custom_textel_presets) - 1 :
+                    (edit_textel_preset != nullptr ? static_cast<int>(edit_textel_preset - custom_textel_presets.data()) : -1);
+                  if (0 <= ctp_idx)
                   {
-                    // Magic Stone
-                    // '%', Magenta, Cyan, 28
-                    // '%', DarkMagenta, DarkCyan, 28
-                    lines_custom_textel_presets.emplace_back(ctp.name);
-                    lines_custom_textel_presets.emplace_back(ctp.textel_normal.glyph.str(false) + ", "
-                      + ctp.textel_normal.fg_color.str() + ", "
-                      + ctp.textel_normal.bg_color.str() + ", "
-                      + std::to_string(ctp.textel_normal.decode_raw_mat()));
-                    lines_custom_textel_presets.emplace_back(ctp.textel_shadow.glyph.str(false) + ", "
-                      + ctp.textel_shadow.fg_color.str() + ", "
-                      + ctp.textel_shadow.bg_color.str() + ", "
-                      + std::to_string(ctp.textel_shadow.decode_raw_mat()));
+                    const auto save_res = save_custom_textel_preset(ctp_idx, added);
+                    if (save_res == PresetSaveResult::Patched)
+                      message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                                   "Successfully wrote to custom textel presets file!",
+                                                   t8x::MessageHandlerLevel::Guide);
+                    else if (save_res == PresetSaveResult::Rewritten)
+                      message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                                   "Custom textel presets file did not match the presets in memory!\n"
+                                                   "Rewrote the whole file without its comments and blank lines.",
+                                                   t8x::MessageHandlerLevel::Guide,
+                                                   3.f);
+                    else
+                      message_handler->add_message(static_cast<float>(get_real_time_s()),
+                                                   "Unable to write to custom textel presets file!",
+                                                   t8x::MessageHandlerLevel::Fatal);
+                    patch_textel_preset(ctp_idx, added);
                   }
-                  if (TextIO::write_file(filepath_custom_textel_presets, lines_custom_textel_presets))
-                    message_handler->add_message(static_cast<float>(get_real_time_s()),
-                                                 "Successfully wrote to custom textel presets file!",
-                                                 t8x::MessageHandlerLevel::Guide);
-                  else
-                    message_handler->add_message(static_cast<float>(get_real_time_s()),
-                                                 "Unable to write to custom textel presets file!",
-                                                 t8x::MessageHandlerLevel::Fatal);
-                                                 
-                  reload_textel_presets();
                 }
                 reset_textel_editor();
                 show_textel_editor = false;
@@ -1727,7 +3008,7 @@ private:
             edit_textel_normal.glyph.try_canonicalize_from_fallback();
             edit_textel_preset_adhoc->textel_normal = edit_textel_normal;
             edit_textel_preset_adhoc->textel_shadow = edit_textel_normal;
-            edit_textel_preset_adhoc->update_disp_strings<CharT>({ Color16::DarkGray, Color16::Transparent2 }, true);
+            edit_textel_preset_adhoc->invalidate_disp_strings({ Color16::DarkGray, Color16::Transparent2 }, true);
             
             if (!edit_textel_presets_as_ascii_only && gp_textel_symbol_adhoc != nullptr)
               gp_textel_symbol_adhoc->push_recent();
@@ -1757,6 +3038,20 @@ private:
         tb_ui_help_edit_adhoc.draw(sh, tb_args);
       }
       
+      if (show_mem_panel)
+      {
+        const auto mem_lines = textur::format_memory_report();
+        for (int l = 0; l < static_cast<int>(mem_lines.size()); ++l)
+          sh.write_buffer(" " + mem_lines[l] + " ", l + 1, 1, Color16::White, Color16::DarkBlue);
+      }
+      if (show_latency_panel)
+      {
+        const int r0 = show_mem_panel ? textur::num_memory_report_lines + 1 : 0;
+        const auto latency_lines = key_latency.format();
+        for (int l = 0; l < static_cast<int>(latency_lines.size()); ++l)
+          sh.write_buffer(" " + latency_lines[l] + " ", r0 + l + 1, 1, Color16::White, Color16::DarkMagenta);
+      }
+      
       // Caret
       if (get_anim_count(0) % 2 == 0
           && (active_menu_width == 0 || screen_pos.c + cursor_pos.c + 1 < nc - active_menu_width))
@@ -1765,33 +3060,49 @@ private:
       draw_coord_sys(draw_vert_coords, draw_horiz_coords, draw_vert_coord_line, draw_horiz_coord_line,
                      nc, active_menu_width);
       
-      int box_width_curr = curr_texture.size.c;
-      int box_width_tracing = tracing_texture.size.c;
-      if (active_menu_width > 0)
-      {
-        if (curr_texture.size.c > nc - active_menu_width)
-          box_width_curr = nc - active_menu_width - screen_pos.c;
-        if (tracing_texture.size.c > nc - active_menu_width)
-          box_width_tracing = nc - active_menu_width - screen_pos.c;
-      }
-      if (show_materials)
+      // Only the visible part of the layers (composited with the tracing texture) is drawn.
+      // The materials are only shown for the active layer.
+      std::vector<const Texture*> stack { &curr_texture };
+      if (!show_materials)
       {
-        t8x::draw_box_texture_materials(sh,
-                                   screen_pos.r, screen_pos.c,
-                                   curr_texture.size.r + 2, box_width_curr + 2,
-                                   curr_texture);
+        stack = visible_layers();
+        if (shading_preview_dir != textur::SunDirection::Zenith)
+          stack = { &get_shading_preview() };
+        if (show_tracing && !tracing_texture.empty())
+          stack.emplace_back(&tracing_texture);
       }
-      else
+      RC stack_size { 0, 0 };
+      for (const auto* tex : stack)
+        stack_size = { std::max(stack_size.r, tex->size.r), std::max(stack_size.c, tex->size.c) };
+      const int view_max_c = active_menu_width > 0 ? nc - active_menu_width : nc;
+      const RC view_org { std::max(0, -screen_pos.r), std::max(0, -screen_pos.c) };
+      const RC view_end { std::min(stack_size.r, nr - screen_pos.r), std::min(stack_size.c, view_max_c - screen_pos.c) };
+      textur::MemScope mem_scope { textur::MemTag::ViewCache };
+      const auto& view = viewport_cache.update(stack, view_org, view_end - view_org);
+      if (!view.empty())
       {
-        // Does not need to be qualified with t8x::drawing, but I'm not sure why.
-        t8x::draw_box_textured(sh,
-                          screen_pos.r, screen_pos.c,
-                          curr_texture.size.r + 2, box_width_curr + 2,
-                          t8x::SolarDirection::Zenith,
-                          curr_texture);
+        if (show_materials)
+        {
+          t8x::draw_box_texture_materials(sh,
+                                     screen_pos.r + view_org.r, screen_pos.c + view_org.c,
+                                     view.size.r + 2, view.size.c + 2,
+                                     view);
+        }
+        else
+        {
+          // Does not need to be qualified with t8x::drawing, but I'm not sure why.
+          t8x::draw_box_textured(sh,
+                            screen_pos.r + view_org.r, screen_pos.c + view_org.c,
+                            view.size.r + 2, view.size.c + 2,
+                            t8x::SolarDirection::Zenith,
+                            view);
+        }
       }
-      if (show_tracing && !tracing_texture.empty())
+      if (show_materials && show_tracing && !tracing_texture.empty())
       {
+        int box_width_tracing = tracing_texture.size.c;
+        if (active_menu_width > 0 && tracing_texture.size.c > nc - active_menu_width)
+          box_width_tracing = nc - active_menu_width - screen_pos.c;
         // Does not need to be qualified with t8x::drawing, but I'm not sure why.
         t8x::draw_box_textured(sh,
                           screen_pos.r, screen_pos.c,
@@ -1801,12 +3112,38 @@ private:
       }
     }
     
-    set_allow_quitting(!show_textel_editor && !show_adhoc_textel_editor);
+    set_allow_quitting(!show_textel_editor && !show_adhoc_textel_editor && !menu_search_typing);
                       
     if (allow_editing)
       handle_editor_key_presses(curr_key, curr_special_key, nri, nci, cursor_pos);
     
     GameEngine::enable_quit_confirm_screen(is_modified);
+    
+    publish_live_preview();
+    
+    // Keys are handled after the frame has been drawn, so their result is drawn in the next
+    //   update, and the engine flushes the screen buffer right after that update returns.
+    if (key_latency_pending)
+    {
+      const auto update_end_time = std::chrono::steady_clock::now();
+      key_latency.add(std::chrono::duration<double, std::milli>(update_end_time - key_received_time).count());
+      key_latency_pending = false;
+    }
+    if (key_received)
+    {
+      key_received_time = update_start_time;
+      key_latency_pending = true;
+    }
+    
+    // The engine flushes the first frame right after this update returns, which is where the
+    //   time to first frame ends. Waiting for the next update would add the frame period.
+    if (num_updates == 0)
+    {
+      startup_profiler.mark("first frame build");
+      if (profile_startup)
+        request_exit();
+    }
+    num_updates++;
   }
   
   virtual void draw_title() override
@@ -1884,17 +3221,95 @@ private:
   int selected_textel_preset_idx = 0;
   std::vector<TextelItem> custom_textel_presets;
   
-  static constexpr size_t max_used_textels = 20;
-  std::vector<Textel> used_textels;
+  textur::PresetIndex<TextelItem> preset_index;
+  textur::MaterialGroupIndex material_groups;
+  textur::CustomPresetFile custom_preset_file;
+  bool menu_group_by_material = false;
+  textur::PresetSearch preset_search;
+  bool menu_search_typing = false;
+  std::string menu_search_query;
+  std::vector<int> menu_search_result;
+  
+  textur::MruList<Textel, textur::TextelHash> used_textels { 20 };
   int selected_used_textel_idx = 0;
 
   std::unique_ptr<t8x::MessageHandler<std::string>> message_handler;
   t8x::MessageBoxDrawingArgs msg_box_drawing_args;
-  using UndoItem = std::vector<std::pair<t8::RC, Textel>>;
-  std::stack<UndoItem> undo_buffer;
-  std::stack<UndoItem> redo_buffer;
+  using UndoStack = std::stack<UndoItem,
+    std::deque<UndoItem, textur::TagAllocator<UndoItem, textur::MemTag::UndoRedo>>>;
+  UndoStack undo_buffer;
+  UndoStack redo_buffer;
   bool is_modified = false;
   
+  // The texture and undo history of the active layer are kept in curr_texture, undo_buffer
+  //   and redo_buffer (see set_active_layer()). Layer 0 is the bottom layer.
+  struct Layer
+  {
+    std::string file_path;
+    Texture texture;
+    UndoStack undo_buffer;
+    UndoStack redo_buffer;
+    bool visible = true;
+    bool locked = false;
+  };
+  std::vector<Layer> layers;
+  int active_layer = 0;
+  std::string file_path_flattened_texture;
+  
+  std::string dir_atlas_sprites;
+  std::string file_path_atlas_texture;
+  int atlas_padding = 0;
+  
+  std::vector<std::string> lint_paths;
+  std::vector<int> lint_materials;
+  std::string lint_shadow_suffix;
+  
+  std::string dir_contact_sheet_textures;
+  std::string file_path_contact_sheet;
+  RC thumbnail_size { 10, 20 };
+  
+  bool stream_ansi = false;
+  int ansi_wrap_width = 80;
+  std::string file_path_import_ansi;
+  std::string file_path_imported_texture;
+  textur::AnsiStreamStats ansi_stream_stats;
+  bool quantize_ansi = false;
+  textur::QuantizeStats quantize_stats;
+  
+  textur::TextureCache texture_cache;
+  bool clear_texture_cache = false;
+  
+  std::string file_path_cpp_header;
+  bool export_cpp_header_shadow = false;
+  std::string file_path_ansi_export;
+  
+  textur::DirectionalShading shading;
+  std::string file_path_shading_base;
+  std::vector<textur::SunDirection> shading_directions;
+  textur::SunDirection shading_preview_dir = textur::SunDirection::Zenith;
+  std::array<Texture, static_cast<size_t>(textur::SunDirection::NUM_ITEMS)> shading_previews;
+  std::array<bool, static_cast<size_t>(textur::SunDirection::NUM_ITEMS)> shading_preview_valid {};
+  
+  textur::StartupProfiler startup_profiler;
+  bool profile_startup = false;
+  double startup_budget_ms = 0.;
+  int num_updates = 0;
+  
+  bool mem_report = false;
+  bool show_mem_panel = false;
+  
+  textur::LatencyHistogram key_latency;
+  std::chrono::steady_clock::time_point key_received_time;
+  bool key_latency_pending = false;
+  bool latency_report = false;
+  bool show_latency_panel = false;
+  
+  std::string live_preview_socket_path;
+  textur::LivePreviewPublisher live_preview;
+  
+  textur::ViewportCache viewport_cache;
+  textur::MaterialOccupancy material_occupancy;
+  
   bool draw_vert_coords = false;
   bool draw_horiz_coords = false;
   bool draw_vert_coord_line = false;
@@ -1904,6 +3319,17 @@ private:
   
   float big_brush_aspect_ratio = 1.84f; // Measured on huge font on MacOS Terminal.
   float big_brush_radius = 10.5f; // Good radius that creates a fairly symmetrically circurlar brush stroke.
+  textur::BrushShape big_brush_shape = textur::BrushShape::Circle;
+  textur::BrushEngine brush_engine;
+  textur::RandomBrush random_brush;
+  std::vector<uint8_t> random_brush_accept;
+  
+  float noise_fill_scale = 8.f;
+  int noise_fill_octaves = 4;
+  RC noise_fill_corner { 0, 0 };
+  bool noise_fill_corner_set = false;
+  float random_brush_density = 1.f;
+  float random_brush_falloff = 0.1f;
   
   t8x::TextBoxDebug tbd { str::Adjustment::Left };
   
@@ -1980,6 +3406,29 @@ private:
   t8x::TextField tf_textel_symbol_adhoc { 1, t8x::TextFieldMode::All, tf_style, 0 };
 };
 
+// All allocations go through the memory tracker so that the memory panel (and --mem_report)
+//   can tell what holds the memory.
+void* operator new(size_t size)
+{
+  if (void* ptr = textur::memory_tracker::allocate(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size)
+{
+  if (void* ptr = textur::memory_tracker::allocate(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return textur::memory_tracker::allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return textur::memory_tracker::allocate(size); }
+void operator delete(void* ptr) noexcept { textur::memory_tracker::deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { textur::memory_tracker::deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { textur::memory_tracker::deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { textur::memory_tracker::deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { textur::memory_tracker::deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { textur::memory_tracker::deallocate(ptr); }
+
 int main(int argc, char** argv)
 {
   t8x::GameEngineParams params;
@@ -2012,5 +3461,10 @@ int main(int argc, char** argv)
 
   Game game(argc, argv, params);
 
-  return game.run();
+  auto ret = game.run();
+  game.report_memory();
+  game.report_latency();
+  if (!game.report_startup_profile())
+    return EXIT_FAILURE;
+  return ret;
 }
@@ -0,0 +1,81 @@
+//
+//  live_preview_viewer.cpp
+//  TextUR
+//
+//  Stand-in for a game or other tool that shows a texture while it is being edited in TextUR.
+//  Start TextUR with --live_preview <socket_path>, then run this with the same socket path.
+//
+
+#include "../LivePreview.h"
+#include "../AnsiExport.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || std::strcmp(argv[1], "--help") == 0)
+  {
+    std::cout << "live_preview_viewer <socket_path> [--stats_only]" << std::endl;
+    std::cout << "  --stats_only : Only prints the number of messages and cells received per second." << std::endl;
+    return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  const bool stats_only = argc > 2 && std::strcmp(argv[2], "--stats_only") == 0;
+
+  textur::LivePreviewReader reader;
+  if (!reader.connect(argv[1]))
+  {
+    std::cerr << "ERROR: Unable to connect to live preview socket \"" << argv[1] << "\"." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  t8::Texture texture;
+  textur::AnsiExport ansi_export { t8::Color16::White, t8::Color16::Transparent2 };
+  textur::LivePreviewMsgType type = textur::LivePreviewMsgType::Snapshot;
+  int num_cells = 0;
+  int num_msgs_window = 0;
+  long long num_cells_window = 0;
+  auto window_start = Clock::now();
+  auto last_draw = Clock::time_point {};
+  bool draw_pending = false;
+  auto draw = [&]()
+  {
+    std::cout << "\x1b[H\x1b[2J" << ansi_export.encode(texture) << std::flush;
+    last_draw = Clock::now();
+    draw_pending = false;
+  };
+
+  while (true)
+  {
+    // Redrawing the whole texture is far slower than applying deltas, so the terminal is
+    //   refreshed at most 30 times per second and whatever is left over once the edits pause.
+    if (draw_pending && !reader.wait(33))
+      draw();
+    if (!reader.receive(texture, type, num_cells))
+      break;
+    num_msgs_window++;
+    num_cells_window += num_cells;
+    const auto now = Clock::now();
+    const double window_s = std::chrono::duration<double>(now - window_start).count();
+    if (window_s >= 1.)
+    {
+      std::cerr << std::fixed << std::setprecision(1)
+                << num_msgs_window / window_s << " msgs/s, " << num_cells_window / window_s << " cells/s" << std::endl;
+      num_msgs_window = 0;
+      num_cells_window = 0;
+      window_start = now;
+    }
+    if (stats_only)
+      continue;
+    draw_pending = true;
+    if (type == textur::LivePreviewMsgType::Snapshot || now - last_draw >= std::chrono::milliseconds(33))
+      draw();
+  }
+  if (draw_pending)
+    draw();
+  std::cerr << "Editor disconnected." << std::endl;
+  return EXIT_SUCCESS;
+}